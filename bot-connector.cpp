@@ -1,5 +1,9 @@
 #include <obs-module.h>
+#include <util/platform.h>
 #include <regex>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <websocketpp/uri.hpp>
 #include <rapidjson/writer.h>
@@ -11,6 +15,31 @@
 
 #define LOG_PREFIX      "BotConnector: "
 
+// Stop handing messages to websocketpp while this much is still waiting for the socket
+#define MAX_SOCKET_BUFFERED_BYTES       (256 * 1024)
+#define MAX_BULK_BUFFERED_BYTES         (32 * 1024)
+#define SOCKET_BUFFERED_RETRY_MSEC      5
+
+// Optional protocol features we offer in ClientFeatures, enabled once listed in ServerFeatures
+#define FEATURE_BINARY_VISION           "BinaryVision"
+#define FEATURE_BATCH                   "Batch"
+#define FEATURE_OVERLAY_DELTA           "OverlayDelta"
+
+#define DEFAULT_BATCH_MAX_BYTES         (64 * 1024)
+#define DEFAULT_DEFLATE_WINDOW_BITS     15
+
+// Round trip measurement for clock synchronization
+#define PING_INTERVAL_MSEC              1000
+
+#define RECONNECT_FIRST_MSEC            100
+#define RECONNECT_BASE_MSEC             250
+#define RECONNECT_MAX_MSEC              10000
+#define RECONNECT_JITTER                0.25
+#define DISCOVERY_TIMEOUT_MSEC          5000
+
+// Larger scenes are rejected while parsing
+#define MAX_OVERLAY_SCENE_QUADS         (1024 * 1024)
+
 using namespace CryptoPP;
 using namespace websocketpp;
 using namespace rapidjson;
@@ -22,20 +51,63 @@ using lib::bind;
 BotConnector::BotConnector()
     : authenticated(false),
       connected(false),
-      can_send(false)
+      can_send(false),
+      binary_vision(false),
+      batch_outbound(false),
+      batch_delay_usec(0),
+      batch_max_bytes(DEFAULT_BATCH_MAX_BYTES),
+      discovery_active(false),
+      connecting(false),
+      restart_pending(false),
+      reconnect_attempts(0),
+      disconnected_at_nsec(0),
+      last_reconnect_nsec(0),
+      reconnect_rng(std::random_device()()),
+      inbound_receive_nsec(0),
+      overlay_sink(0),
+      scene_parser(MAX_OVERLAY_SCENE_QUADS),
+      scene_pending(false),
+      full_scene_pending(false),
+      resync_requested(false)
 {
+    deflate_settings.enabled = false;
+    deflate_settings.no_context_takeover = false;
+    deflate_settings.max_window_bits = DEFAULT_DEFLATE_WINDOW_BITS;
+
     thread_client = new client_t;
     thread_client->init_asio();
 
+    thread_client->set_message_handler(bind(&BotConnector::on_socket_message, this, ::_1, ::_2));
+    thread_client->set_open_handler(bind(&BotConnector::on_socket_open, this, ::_1));
+    thread_client->set_close_handler(bind(&BotConnector::on_socket_close, this, ::_1));
+    thread_client->set_fail_handler(bind(&BotConnector::on_socket_fail, this, ::_1));
+    thread_client->set_pong_handler(bind(&BotConnector::on_socket_pong, this, ::_1, ::_2));
+
     conn_timer = new asio::steady_timer(thread_client->get_io_service());
+    drain_timer = new asio::steady_timer(thread_client->get_io_service());
+    batch_timer = new asio::steady_timer(thread_client->get_io_service());
+    curl_timer = new asio::steady_timer(thread_client->get_io_service());
+    ping_timer = new asio::steady_timer(thread_client->get_io_service());
+    conn_watcher = new FileWatcher(thread_client->get_io_service(),
+        bind(&BotConnector::on_connection_file_changed, this));
 
     thread_curl = curl_easy_init();
-    if (!thread_curl) {
+    thread_curlm = curl_multi_init();
+    if (!thread_curl || !thread_curlm) {
         blog(LOG_ERROR, "Curl failed to init");
         abort();
     }
 
-    async_reconnect();
+    curl_multi_setopt(thread_curlm, CURLMOPT_SOCKETFUNCTION, curl_socket_callback);
+    curl_multi_setopt(thread_curlm, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(thread_curlm, CURLMOPT_TIMERFUNCTION, curl_timer_callback);
+    curl_multi_setopt(thread_curlm, CURLMOPT_TIMERDATA, this);
+    curl_easy_setopt(thread_curl, CURLOPT_OPENSOCKETFUNCTION, curl_open_socket);
+    curl_easy_setopt(thread_curl, CURLOPT_OPENSOCKETDATA, this);
+    curl_easy_setopt(thread_curl, CURLOPT_CLOSESOCKETFUNCTION, curl_close_socket);
+    curl_easy_setopt(thread_curl, CURLOPT_CLOSESOCKETDATA, this);
+
+    // Connecting starts once we know where the connection file is
     thread = std::thread(bind(&BotConnector::thread_func, this));
 }
 
@@ -44,15 +116,34 @@ BotConnector::~BotConnector()
     can_send = false;
     thread_client->get_io_service().stop();
     thread.join();
+
+    // Curl closes its sockets and clears its timer through our callbacks, so it
+    // goes before the io_service and the timer it uses
+    if (discovery_active) {
+        curl_multi_remove_handle(thread_curlm, thread_curl);
+    }
+    curl_multi_cleanup(thread_curlm);
+    curl_easy_cleanup(thread_curl);
+    curl_sockets.clear();
+
     delete conn_timer;
+    delete drain_timer;
+    delete batch_timer;
+    delete curl_timer;
+    delete ping_timer;
+    delete conn_watcher;
     delete thread_client;
-    curl_easy_cleanup(thread_curl);
 }
 
 void BotConnector::set_connection_file_path(const char *path)
 {
     std::lock_guard<std::mutex> lock(conn_path_mutex);
-    conn_path = path;
+    if (conn_path != path) {
+        conn_path = path;
+        thread_client->get_io_service().post([=] () {
+            watch_connection_file();
+        });
+    }
 }
 
 std::string BotConnector::get_connection_file_path()
@@ -62,15 +153,77 @@ std::string BotConnector::get_connection_file_path()
     return copy;
 }
 
-void BotConnector::send(StringBuffer* buffer)
+void BotConnector::send(MessageBuffer* buffer, MessageKind kind, bool binary)
 {
-    if (can_send) {
-        thread_client->get_io_service().dispatch([=] () {
-            local_send(buffer);
+    if (!can_send) {
+        outbound.count_dropped();
+        release_message(buffer);
+        return;
+    }
+    if (outbound.push(kind, buffer, binary)) {
+        thread_client->get_io_service().post([=] () {
+            schedule_drain();
+        });
+    } else if (outbound.get_pending_bytes() >= batch_max_bytes.load() ||
+        (OutboundQueue::lane_for(kind) == MessageLane::Control && !batch_delay_usec.load())) {
+        // Don't leave a control message waiting on a retry timer meant for bulk traffic
+        thread_client->get_io_service().post([=] () {
+            drain_outbound();
         });
     }
 }
 
+void BotConnector::set_compression(DeflateSettings const &settings)
+{
+    std::lock_guard<std::mutex> lock(deflate_mutex);
+    deflate_settings = settings;
+    deflate_settings.max_window_bits = std::max<uint8_t>(9, std::min<uint8_t>(15, settings.max_window_bits));
+}
+
+void BotConnector::set_batch_limits(uint32_t max_delay_usec, uint32_t max_bytes)
+{
+    batch_delay_usec.store(max_delay_usec);
+    batch_max_bytes.store(max_bytes);
+}
+
+void BotConnector::send(RegionTrackingResult const &result, MessageBuilder &builder)
+{
+    bool binary = binary_vision.load();
+    uint64_t start = os_gettime_ns();
+    MessageBuffer *buffer = encode_message(result, builder, binary);
+    serialize_latency.record(os_gettime_ns() - start);
+    send(buffer, MessageKind::CameraRegionTracking, binary);
+}
+
+void BotConnector::send(ObjectDetectionResult const &result, MessageBuilder &builder)
+{
+    bool binary = binary_vision.load();
+    uint64_t start = os_gettime_ns();
+    MessageBuffer *buffer = encode_message(result, builder, binary);
+    serialize_latency.record(os_gettime_ns() - start);
+    send(buffer, MessageKind::CameraObjectDetection, binary);
+}
+
+OutboundQueue::Stats BotConnector::get_outbound_stats()
+{
+    return outbound.get_stats();
+}
+
+LatencyHistogram::Snapshot BotConnector::get_outbound_latency(MessageLane lane)
+{
+    return outbound.get_latency(lane);
+}
+
+LatencyHistogram::Snapshot BotConnector::get_serialize_latency()
+{
+    return serialize_latency.snapshot();
+}
+
+LatencyHistogram::Snapshot BotConnector::get_enqueue_latency()
+{
+    return enqueue_latency.snapshot();
+}
+
 bool BotConnector::is_authenticated()
 {
     return authenticated;
@@ -85,30 +238,214 @@ bool BotConnector::poll_for_tracking_region_reset(double rect[4])
     return result;
 }
 
-void BotConnector::local_send(StringBuffer* buffer)
+void BotConnector::local_send(MessageBuffer* buffer, bool binary)
+{
+    socket_send(buffer->GetString(), buffer->GetSize(), binary);
+    release_message(buffer);
+}
+
+void BotConnector::socket_send(const char *data, size_t size, bool binary)
 {
     if (active_conn.lock()) {
-        thread_client->send(active_conn,
-            buffer->GetString(), buffer->GetSize(),
-            frame::opcode::TEXT);
+        // websocketpp copies the payload into a message it allocates, so our buffer can be reused right away
+        uint64_t start = os_gettime_ns();
+        thread_client->send(active_conn, data, size,
+            binary ? frame::opcode::BINARY : frame::opcode::TEXT);
+        enqueue_latency.record(os_gettime_ns() - start);
+        outbound.count_frame();
+    }
+}
+
+void BotConnector::schedule_drain()
+{
+    uint32_t delay = batch_outbound ? batch_delay_usec.load() : 0;
+    if (!delay) {
+        drain_outbound();
+        return;
+    }
+
+    // Give more messages a chance to join this batch
+    batch_timer->expires_from_now(std::chrono::microseconds(delay));
+    batch_timer->async_wait([=] (const asio::error_code &ec) {
+        if (!ec) {
+            drain_outbound();
+        }
+    });
+}
+
+bool BotConnector::send_batch(bool allow_bulk)
+{
+    // Everything pending goes out as at most one TEXT and one BINARY frame. The size
+    // limit is checked before each message, so a batch can exceed it by one message.
+
+    size_t max_bytes = batch_max_bytes.load();
+    unsigned text_count = 0, binary_count = 0;
+    OutboundQueue::Message msg;
+
+    batch_text.Clear();
+    batch_binary.Clear();
+
+    while (batch_text.GetSize() + batch_binary.GetSize() < max_bytes && outbound.pop(msg, allow_bulk)) {
+        if (msg.binary) {
+            if (!binary_count) {
+                memset(batch_binary.Push(4), 0, 4);
+            }
+            uint32_t size = (uint32_t) msg.buffer->GetSize();
+            uint8_t len[4] = { (uint8_t) size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24) };
+            memcpy(batch_binary.Push(sizeof len), len, sizeof len);
+            memcpy(batch_binary.Push(size), msg.buffer->GetString(), size);
+            binary_count++;
+        } else {
+            const char *prefix = text_count ? "," : "{\"Batch\":[";
+            size_t prefix_len = strlen(prefix);
+            memcpy(batch_text.Push(prefix_len), prefix, prefix_len);
+            memcpy(batch_text.Push(msg.buffer->GetSize()), msg.buffer->GetString(), msg.buffer->GetSize());
+            text_count++;
+        }
+        release_message(msg.buffer);
+    }
+
+    if (text_count) {
+        memcpy(batch_text.Push(2), "]}", 2);
+        socket_send(batch_text.GetString(), batch_text.GetSize(), false);
+    }
+    if (binary_count) {
+        // Batch header in the same layout as a single binary record's header
+        uint8_t *header = reinterpret_cast<uint8_t*>(const_cast<char*>(batch_binary.GetString()));
+        header[0] = BINARY_BATCH;
+        header[1] = BINARY_MESSAGE_VERSION;
+        header[2] = (uint8_t) binary_count;
+        header[3] = (uint8_t)(binary_count >> 8);
+        socket_send(batch_binary.GetString(), batch_binary.GetSize(), true);
     }
-    delete buffer;
+
+    return text_count || binary_count;
+}
+
+void BotConnector::drain_outbound()
+{
+    lib::error_code err;
+    connection_ptr con = thread_client->get_con_from_hdl(active_conn, err);
+    if (err || !con) {
+        outbound.clear();
+        return;
+    }
+
+    OutboundQueue::Message msg;
+    size_t buffered;
+    while ((buffered = con->get_buffered_amount()) < MAX_SOCKET_BUFFERED_BYTES) {
+        // Bulk traffic stops well short of the socket limit, so control messages
+        // never queue behind much of it inside websocketpp either
+        bool allow_bulk = buffered < MAX_BULK_BUFFERED_BYTES;
+        bool sent;
+        if (batch_outbound) {
+            sent = send_batch(allow_bulk);
+        } else {
+            sent = outbound.pop(msg, allow_bulk);
+            if (sent) {
+                local_send(msg.buffer, msg.binary);
+            }
+        }
+        if (!sent) {
+            if (allow_bulk || !outbound.get_pending_count()) {
+                return;
+            }
+            break;
+        }
+    }
+
+    // The socket is behind; leave the rest queued where newer results can still replace them
+    drain_timer->expires_from_now(std::chrono::milliseconds(SOCKET_BUFFERED_RETRY_MSEC));
+    drain_timer->async_wait([=] (const asio::error_code &ec) {
+        if (!ec) {
+            drain_outbound();
+        }
+    });
 }
 
 void BotConnector::on_socket_open(connection_hdl conn)
 {
+    last_reconnect_nsec = os_gettime_ns() - disconnected_at_nsec;
+    disconnected_at_nsec = 0;
+    blog(LOG_INFO, LOG_PREFIX "Connected to %s after %.1f ms, %u attempts", ws_uri.c_str(),
+        last_reconnect_nsec / 1e6, reconnect_attempts);
+    cached_ws_uri = ws_uri;
+    connecting = false;
+
+    client_t::connection_ptr con = thread_client->get_con_from_hdl(conn);
+    std::string offered = con->get_request_header("Sec-WebSocket-Extensions");
+    std::string extensions = con->get_response_header("Sec-WebSocket-Extensions");
+    inbound_stats.compressed = extensions.find("permessage-deflate") != std::string::npos;
+    if (inbound_stats.compressed) {
+        blog(LOG_INFO, LOG_PREFIX "Compression enabled, %s", extensions.c_str());
+    } else if (!offered.empty()) {
+        blog(LOG_INFO, LOG_PREFIX "Compression offered but not accepted, %s", offered.c_str());
+    }
+
     active_conn = conn;
+    binary_vision = false;
+    batch_outbound = false;
     can_send = true;
+    resync_requested = false;
     send_subscription();
+    send_client_features();
+
+    // May be a different controller, with a different clock
+    clock.reset();
+    send_ping();
+
+    if (restart_pending) {
+        // The controller moved while this connection was being set up
+        restart_pending = false;
+        restart_connection();
+    }
 }
 
 void BotConnector::on_socket_close(connection_hdl conn)
 {
     active_conn = connection_hdl();
     can_send = false;
+    drain_timer->cancel();
+    batch_timer->cancel();
+    ping_timer->cancel();
+    outbound.clear();
     async_reconnect();
 }
 
+void BotConnector::send_ping()
+{
+    if (!active_conn.expired()) {
+        lib::error_code err;
+        thread_client->ping(active_conn, std::to_string(os_gettime_ns()), err);
+    }
+
+    ping_timer->expires_from_now(std::chrono::milliseconds(PING_INTERVAL_MSEC));
+    ping_timer->async_wait([=] (const asio::error_code &ec) {
+        if (!ec) {
+            send_ping();
+        }
+    });
+}
+
+void BotConnector::on_socket_pong(connection_hdl conn, std::string payload)
+{
+    uint64_t sent = strtoull(payload.c_str(), NULL, 10);
+    uint64_t now = os_gettime_ns();
+    if (sent && sent <= now) {
+        clock.add_rtt_sample(now - sent);
+    }
+}
+
+double BotConnector::controller_time(uint64_t local_nsec)
+{
+    return clock.to_controller_time(local_nsec);
+}
+
+ClockSync::Stats BotConnector::get_clock_stats()
+{
+    return clock.get_stats();
+}
+
 void BotConnector::on_socket_message(connection_hdl conn, message_ptr msg)
 {
     if (!connected) {
@@ -116,20 +453,38 @@ void BotConnector::on_socket_message(connection_hdl conn, message_ptr msg)
         connected = true;
     }
 
+    if (msg->get_opcode() == frame::opcode::BINARY) {
+        inbound_receive_nsec = os_gettime_ns();
+        inbound_stats.messages++;
+        inbound_stats.bytes += msg->get_payload().size();
+        on_binary_message((const uint8_t*) msg->get_payload().data(), msg->get_payload().size());
+        return;
+    }
+
+    // Parsed in place with SAX events. Once authenticated, overlay scenes in Stream
+    // messages go straight into the sink, and everything else builds a normal DOM in
+    // which each scene is a placeholder Bool.
+    uint64_t parse_start = os_gettime_ns();
+    inbound_receive_nsec = parse_start;
     Document doc;
-    doc.ParseInsitu((char*) msg->get_payload().c_str());
+    char *payload = (char*) msg->get_payload().c_str();
+    auto generator = [&] (Document &handler) {
+        OverlaySceneFilter<Document> filter(handler, scene_parser, overlay_sink, authenticated);
+        InsituStringStream stream(payload);
+        Reader reader;
+        return !reader.Parse<kParseInsituFlag>(stream, filter).IsError();
+    };
+    doc.Populate(generator);
     Value const* obj;
 
+    inbound_stats.messages++;
+    inbound_stats.bytes += msg->get_payload().size();
+    inbound_stats.parse_nsec += os_gettime_ns() - parse_start;
+
+    // Only subscribed streams are expected, and we subscribe once authenticated
     obj = json_obj(doc, "Stream");
-    if (obj && obj->IsArray()) {
-        for (SizeType i = 0; i < obj->Size(); i++) {
-            const Value &ts_msg = (*obj)[i];
-            double timestamp = json_double(ts_msg, "timestamp");
-            Value const* msg = json_obj(ts_msg, "message");
-            if (msg && msg->IsObject()) {
-                on_stream_message(*msg, timestamp);
-            }
-        }
+    if (authenticated && obj && obj->IsArray()) {
+        on_stream_batch(*obj);
     }
 
     obj = json_obj(doc, "Auth");
@@ -146,42 +501,152 @@ void BotConnector::on_socket_message(connection_hdl conn, message_ptr msg)
     if (obj && obj->IsObject()) {
         on_error_message(*obj);
     }
+
+    obj = json_obj(doc, "ServerFeatures");
+    if (obj && obj->IsArray()) {
+        on_server_features(*obj);
+    }
 }
 
 void BotConnector::send_subscription()
 {
-    Document d;
-    d.SetObject();
+    MessageDocument &d = io_builder.begin();
 
-    Value message_list;
+    MessageValue message_list;
     message_list.SetArray();
 
     message_list.PushBack("ConfigIsCurrent", d.GetAllocator());
     message_list.PushBack("Command", d.GetAllocator());
     message_list.PushBack("CameraOverlayScene", d.GetAllocator());
+    message_list.PushBack("CameraOverlayDelta", d.GetAllocator());
     message_list.PushBack("CameraInitTrackedRegion", d.GetAllocator());
 
     d.AddMember("Subscription", message_list, d.GetAllocator());
 
-    StringBuffer *buffer = new StringBuffer();
-    Writer<StringBuffer> writer(*buffer);
-    d.Accept(writer);
+    local_send(io_builder.finish());
+}
+
+void BotConnector::send_client_features()
+{
+    MessageDocument &d = io_builder.begin();
+
+    MessageValue feature_list;
+    feature_list.SetArray();
+
+    feature_list.PushBack(FEATURE_BINARY_VISION, d.GetAllocator());
+    feature_list.PushBack(FEATURE_BATCH, d.GetAllocator());
+    feature_list.PushBack(FEATURE_OVERLAY_DELTA, d.GetAllocator());
+
+    d.AddMember("ClientFeatures", feature_list, d.GetAllocator());
+
+    local_send(io_builder.finish());
+}
+
+void BotConnector::on_server_features(Value const &features)
+{
+    bool binary = false;
+    bool batch = false;
+
+    for (SizeType i = 0; i < features.Size(); i++) {
+        if (features[i].IsString() && !strcmp(features[i].GetString(), FEATURE_BINARY_VISION)) {
+            binary = true;
+        }
+        if (features[i].IsString() && !strcmp(features[i].GetString(), FEATURE_BATCH)) {
+            batch = true;
+        }
+    }
+
+    binary_vision = binary;
+    batch_outbound = batch;
+    blog(LOG_INFO, LOG_PREFIX "Server features received, vision results use %s encoding, batching %s",
+        binary ? "binary" : "JSON", batch ? "on" : "off");
+}
+
+static int find_newest_in_batch(Value const &batch, const char *type)
+{
+    int newest = -1;
+    double newest_timestamp = 0.0;
+
+    for (SizeType i = 0; i < batch.Size(); i++) {
+        Value const* msg = json_obj(batch[i], "message");
+        if (msg && json_obj(*msg, type)) {
+            double timestamp = json_double(batch[i], "timestamp");
+            if (newest < 0 || timestamp >= newest_timestamp) {
+                newest = i;
+                newest_timestamp = timestamp;
+            }
+        }
+    }
+    return newest;
+}
+
+static int find_last_complete_scene(Value const &batch)
+{
+    int last = -1;
+    for (SizeType i = 0; i < batch.Size(); i++) {
+        Value const* msg = json_obj(batch[i], "message");
+        Value const* scene = msg ? json_obj(*msg, "CameraOverlayScene") : 0;
+        if (scene && scene->IsBool() && scene->GetBool()) {
+            last = i;
+        }
+    }
+    return last;
+}
 
-    local_send(buffer);
+void BotConnector::on_stream_batch(Value const &batch)
+{
+    // Tracked regions replace all earlier ones, so only the newest in a batch is used.
+    // Overlay scenes were already written in arrival order while parsing, so the model
+    // holds the last complete one; deltas from before it were meant for a scene
+    // that's gone, and only the ones after it apply.
+    int newest_region = find_newest_in_batch(batch, "CameraInitTrackedRegion");
+    int last_scene = find_last_complete_scene(batch);
+    double newest_timestamp = 0.0;
+
+    for (SizeType i = 0; i < batch.Size(); i++) {
+        const Value &ts_msg = batch[i];
+        double timestamp = json_double(ts_msg, "timestamp");
+        newest_timestamp = std::max(newest_timestamp, timestamp);
+        Value const* msg = json_obj(ts_msg, "message");
+        if (msg && msg->IsObject()) {
+            on_stream_message(*msg, (int)i == newest_region, (int)i < last_scene);
+        }
+    }
+
+    // Older messages in a batch waited on the server; the newest one has the least delay
+    if (newest_timestamp > 0.0) {
+        clock.add_timestamp_sample(newest_timestamp, inbound_receive_nsec);
+    }
 }
 
-void BotConnector::on_stream_message(Value const &msg, double timestamp)
+void BotConnector::on_stream_message(Value const &msg, bool newest_region, bool superseded_scene)
 {
-    Value const* obj;                                                                
+    Value const* obj;
 
+    // Placeholder left by the scene parser; false if the scene was rejected. The
+    // parser already gave the sink its CameraOverlaySceneVersion.
     obj = json_obj(msg, "CameraOverlayScene");
-    if (obj && obj->IsArray()) {
-        on_camera_overlay_scene(*obj);
+    if (obj && obj->IsBool() && obj->GetBool()) {
+        resync_requested = false;
+        queue_overlay_scene(true);
+    }
+
+    obj = json_obj(msg, "CameraOverlayDelta");
+    if (obj && obj->IsObject()) {
+        if (superseded_scene) {
+            inbound_stats.deltas_superseded++;
+        } else if (decode_overlay_delta(*obj, inbound_delta)) {
+            apply_overlay_delta(inbound_delta);
+        }
     }
 
     obj = json_obj(msg, "CameraInitTrackedRegion");
     if (obj && obj->IsArray()) {
-        on_camera_init_tracked_region(*obj);
+        if (newest_region) {
+            on_camera_init_tracked_region(*obj);
+        } else {
+            inbound_stats.regions_dropped++;
+        }
     }
 
     Value const* cmd = json_obj(msg, "Command");
@@ -194,6 +659,103 @@ void BotConnector::on_stream_message(Value const &msg, double timestamp)
     }
 }
 
+void BotConnector::on_binary_message(const uint8_t *data, size_t size)
+{
+    if (size >= 1 && data[0] == BINARY_OVERLAY_DELTA) {
+        if (decode_overlay_delta(data, size, inbound_delta)) {
+            apply_overlay_delta(inbound_delta);
+        } else {
+            blog(LOG_WARNING, LOG_PREFIX "Malformed binary overlay delta, %u bytes", (unsigned) size);
+        }
+    }
+}
+
+void BotConnector::apply_overlay_delta(OverlaySceneDelta const &delta)
+{
+    if (!overlay_sink) {
+        return;
+    }
+    if (overlay_sink->apply_delta(delta)) {
+        inbound_stats.deltas_applied++;
+        queue_overlay_scene(false);
+    } else {
+        inbound_stats.deltas_rejected++;
+        send_overlay_resync();
+    }
+}
+
+void BotConnector::send_overlay_resync()
+{
+    // Once per gap; deltas still in flight would only repeat the request
+    if (resync_requested) {
+        return;
+    }
+    resync_requested = true;
+    blog(LOG_INFO, LOG_PREFIX "Overlay delta doesn't match scene version %u, requesting a full scene",
+        overlay_sink->get_scene_version());
+
+    MessageDocument &d = io_builder.begin();
+
+    MessageValue resync;
+    resync.SetObject();
+    resync.AddMember("version", overlay_sink->get_scene_version(), d.GetAllocator());
+
+    d.AddMember("CameraOverlayResync", resync, d.GetAllocator());
+
+    local_send(io_builder.finish());
+}
+
+void BotConnector::queue_overlay_scene(bool full_scene)
+{
+    // Uploading the overlay is expensive. Publish once the io thread has finished with
+    // messages that already arrived, so newer scenes or deltas in that backlog are included.
+
+    if (scene_pending) {
+        if (full_scene && full_scene_pending) {
+            // The earlier scene was overwritten before anyone saw it
+            inbound_stats.scenes_dropped++;
+        }
+        full_scene_pending = full_scene_pending || full_scene;
+        return;
+    }
+
+    scene_pending = true;
+    full_scene_pending = full_scene;
+    thread_client->get_io_service().post([=] () {
+        apply_pending_scene();
+    });
+}
+
+void BotConnector::apply_pending_scene()
+{
+    if (scene_pending && overlay_sink && overlay_sink->publish_scene() && full_scene_pending) {
+        inbound_stats.scenes_applied++;
+    }
+    scene_pending = false;
+    full_scene_pending = false;
+}
+
+void BotConnector::set_overlay_sink(OverlaySceneSink *sink)
+{
+    overlay_sink = sink;
+}
+
+BotConnector::InboundStats BotConnector::get_inbound_stats()
+{
+    InboundStats copy;
+    copy.messages = inbound_stats.messages.load();
+    copy.scenes_applied = inbound_stats.scenes_applied.load();
+    copy.scenes_dropped = inbound_stats.scenes_dropped.load();
+    copy.deltas_applied = inbound_stats.deltas_applied.load();
+    copy.deltas_rejected = inbound_stats.deltas_rejected.load();
+    copy.deltas_superseded = inbound_stats.deltas_superseded.load();
+    copy.regions_dropped = inbound_stats.regions_dropped.load();
+    copy.bytes = inbound_stats.bytes.load();
+    copy.parse_nsec = inbound_stats.parse_nsec.load();
+    copy.compressed = inbound_stats.compressed.load();
+    return copy;
+}
+
 void BotConnector::on_camera_init_tracked_region(rapidjson::Value const &rect)
 {
     if (rect.Size() == 4) {
@@ -209,7 +771,7 @@ void BotConnector::on_camera_init_tracked_region(rapidjson::Value const &rect)
 
 void BotConnector::on_auth_challenge(const char *challenge)
 {
-    Document d;
+    MessageDocument &d = io_builder.begin();
 
     HMAC<SHA512> hmac((const byte*)auth_key.c_str(), auth_key.size());
     std::string digest_str;
@@ -221,25 +783,21 @@ void BotConnector::on_auth_challenge(const char *challenge)
             )
         )
     );
-    Value digest(StringRef(digest_str.c_str(), digest_str.size()));
+    MessageValue digest(StringRef(digest_str.c_str(), digest_str.size()));
 
-    d.SetObject();
-    Value auth;
+    MessageValue auth;
     auth.SetObject();
     auth.AddMember("digest", digest, d.GetAllocator());
     d.AddMember("Auth", auth, d.GetAllocator());
 
-    StringBuffer *buffer = new StringBuffer();
-    Writer<StringBuffer> writer(*buffer);
-    d.Accept(writer);
-
-    local_send(buffer);
+    local_send(io_builder.finish());
 }
 
 void BotConnector::on_auth_status(bool status)
 {
     authenticated = status;
     if (status) {
+        reconnect_attempts = 0;
         blog(LOG_INFO, LOG_PREFIX "authenticated with server");
     } else {
         blog(LOG_ERROR, LOG_PREFIX "authentiation FAILED, closing connection");
@@ -258,49 +816,87 @@ void BotConnector::on_error_message(Value const &error)
 
 void BotConnector::async_reconnect()
 {
-    conn_timer->expires_from_now(std::chrono::seconds(1));
-    conn_timer->async_wait(bind(&BotConnector::reconnect_handler, this));
+    if (!disconnected_at_nsec) {
+        disconnected_at_nsec = os_gettime_ns();
+    }
+
+    // Setting a new expiry cancels any reconnect that was already scheduled
+    conn_timer->expires_from_now(std::chrono::milliseconds(next_reconnect_delay_msec()));
+    conn_timer->async_wait([=] (const asio::error_code &ec) {
+        if (!ec) {
+            reconnect_handler();
+        }
+    });
 }
 
-void BotConnector::reconnect_handler()
+unsigned BotConnector::next_reconnect_delay_msec()
 {
-    if (!try_reconnect()) {
-        // No? Keep trying...
-        async_reconnect();
+    // Fast first retry, then jittered exponential backoff
+    unsigned attempt = reconnect_attempts++;
+    if (!attempt) {
+        return RECONNECT_FIRST_MSEC;
     }
+
+    double delay = RECONNECT_BASE_MSEC * pow(2.0, std::min(attempt - 1, 16u));
+    delay = std::min(delay, (double) RECONNECT_MAX_MSEC);
+
+    std::uniform_real_distribution<double> jitter(1.0 - RECONNECT_JITTER, 1.0 + RECONNECT_JITTER);
+    return (unsigned)(delay * jitter(reconnect_rng));
 }
 
-bool BotConnector::try_reconnect()
+void BotConnector::reconnect_handler()
 {
     authenticated = false;
     connected = false;
 
-    frontend_uri = read_connection_frontend_uri();
     if (frontend_uri.empty()) {
-        return false;
+        // Nothing to connect to; the connection file watcher restarts us
+        return;
     }
 
-    ws_uri = request_websocket_uri(frontend_uri);
-    auth_key = parse_frontend_auth_key(frontend_uri);
-
-    if (ws_uri.empty()) {
-        return false;
+    if (!cached_ws_uri.empty()) {
+        // Skip discovery; if the old address stops working, the failure clears the cache
+        connect_websocket(cached_ws_uri);
+    } else if (!start_discovery()) {
+        async_reconnect();
     }
+}
 
-    thread_client->set_message_handler(bind(&BotConnector::on_socket_message, this, ::_1, ::_2));
-    thread_client->set_open_handler(bind(&BotConnector::on_socket_open, this, ::_1));
-    thread_client->set_close_handler(bind(&BotConnector::on_socket_close, this, ::_1));
-    thread_client->set_fail_handler(bind(&BotConnector::async_reconnect, this));
+void BotConnector::connect_websocket(std::string const &uri)
+{
+    ws_uri = uri;
 
     lib::error_code err;
     client_t::connection_ptr connection = thread_client->get_connection(ws_uri, err);
     if (err) {
         blog(LOG_ERROR, LOG_PREFIX "WebSocket connection error, %s", err.message().c_str());
-        return false;
+        cached_ws_uri.clear();
+        async_reconnect();
+        return;
+    }
+
+    std::string offer;
+    {
+        std::lock_guard<std::mutex> lock(deflate_mutex);
+        offer = deflate_offer(deflate_settings);
+    }
+    if (!offer.empty()) {
+        connection->replace_header("Sec-WebSocket-Extensions", offer);
     }
 
     blog(LOG_INFO, LOG_PREFIX "Starting connection to %s", ws_uri.c_str());
     thread_client->connect(connection);
+    connecting = true;
+}
+
+void BotConnector::on_socket_fail(connection_hdl conn)
+{
+    connecting = false;
+    restart_pending = false;
+    if (ws_uri == cached_ws_uri) {
+        cached_ws_uri.clear();
+    }
+    async_reconnect();
 }
 
 static void rtrim(char *str)
@@ -317,6 +913,59 @@ static void rtrim(char *str)
     str[len] = '\0';
 }
 
+void BotConnector::watch_connection_file()
+{
+    std::string path = get_connection_file_path();
+    if (path != watched_path) {
+        watched_path = path;
+        conn_watcher->watch(path);
+        on_connection_file_changed();
+    }
+}
+
+void BotConnector::on_connection_file_changed()
+{
+    // A missing or unreadable file keeps whatever connection we already have
+    std::string new_frontend_uri = read_connection_frontend_uri();
+    if (new_frontend_uri.empty() || new_frontend_uri == frontend_uri) {
+        return;
+    }
+
+    blog(LOG_INFO, LOG_PREFIX "Connection file changed, reconnecting");
+    frontend_uri = new_frontend_uri;
+    auth_key = parse_frontend_auth_key(frontend_uri);
+    cached_ws_uri.clear();
+    restart_connection();
+}
+
+void BotConnector::restart_connection()
+{
+    reconnect_attempts = 0;
+
+    if (discovery_active) {
+        curl_timer->cancel();
+        curl_multi_remove_handle(thread_curlm, thread_curl);
+        discovery_active = false;
+    }
+
+    if (connecting) {
+        // Let the attempt finish; open or fail handlers pick up the new address
+        restart_pending = true;
+        return;
+    }
+
+    if (!active_conn.expired()) {
+        // The close handler reconnects
+        lib::error_code err;
+        thread_client->close(active_conn, websocketpp::close::status::going_away, "Controller moved", err);
+        if (!err) {
+            return;
+        }
+    }
+
+    async_reconnect();
+}
+
 std::string BotConnector::read_connection_frontend_uri()
 {
     char buffer[256];
@@ -341,46 +990,193 @@ std::string BotConnector::read_connection_frontend_uri()
     return result;
 }
 
-std::string BotConnector::request_websocket_uri(std::string const &frontend_uri)
+static size_t discovery_write(char *buf, size_t size, size_t num, void *user)
+{
+    std::string &json_buffer = *static_cast<std::string*>(user);
+    size *= num;
+    json_buffer.append((char*) buf, size);
+    return size;
+}
+
+bool BotConnector::start_discovery()
 {
     uri fe(frontend_uri);
     if (!fe.get_valid()) {
         blog(LOG_ERROR, LOG_PREFIX "No valid URI for Bot-Controller HTTP frontend");
-        return std::string();
+        return false;
     }
 
     uri ep(fe.get_scheme(), fe.get_host(), fe.get_port(), "/ws");
-    std::string endpoint_url = ep.str();
+    discovery_url = ep.str();
+    discovery_buffer.clear();
 
-    curl_easy_setopt(thread_curl, CURLOPT_URL, endpoint_url.c_str());
+    curl_easy_setopt(thread_curl, CURLOPT_URL, discovery_url.c_str());
     curl_easy_setopt(thread_curl, CURLOPT_ERRORBUFFER, curl_errbuf);
+    curl_easy_setopt(thread_curl, CURLOPT_CONNECTTIMEOUT_MS, (long) DISCOVERY_TIMEOUT_MSEC);
+    curl_easy_setopt(thread_curl, CURLOPT_TIMEOUT_MS, (long) DISCOVERY_TIMEOUT_MSEC);
+    curl_easy_setopt(thread_curl, CURLOPT_WRITEDATA, &discovery_buffer);
+    curl_easy_setopt(thread_curl, CURLOPT_WRITEFUNCTION, discovery_write);
     curl_errbuf[0] = '\0';
 
-    std::string json_buffer;
-    curl_write_callback json_writer = [] (char *buf, size_t size, size_t num, void *user) -> size_t {
-        std::string &json_buffer = *static_cast<std::string*>(user);
-        size *= num;
-        json_buffer.append((char*) buf, size);
-        return size;
-    };
+    // Curl starts the transfer from its timer callback
+    discovery_active = true;
+    curl_multi_add_handle(thread_curlm, thread_curl);
+    return true;
+}
+
+void BotConnector::check_discovery_done()
+{
+    int queued = 0;
+    while (CURLMsg *msg = curl_multi_info_read(thread_curlm, &queued)) {
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == thread_curl) {
+            finish_discovery(msg->data.result);
+            return;
+        }
+    }
+}
+
+curl_socket_t BotConnector::curl_open_socket(void *user, curlsocktype purpose, struct curl_sockaddr *address)
+{
+    BotConnector *self = static_cast<BotConnector*>(user);
+    if (purpose != CURLSOCKTYPE_IPCXN || (address->family != AF_INET && address->family != AF_INET6)) {
+        return CURL_SOCKET_BAD;
+    }
+
+    std::unique_ptr<CurlSocket> s(new CurlSocket(self->thread_client->get_io_service()));
+    asio::error_code ec;
+    s->socket.open(address->family == AF_INET ? asio::ip::tcp::v4() : asio::ip::tcp::v6(), ec);
+    if (ec) {
+        blog(LOG_ERROR, LOG_PREFIX "Can't open discovery socket: %s", ec.message().c_str());
+        return CURL_SOCKET_BAD;
+    }
+
+    curl_socket_t fd = s->socket.native_handle();
+    self->curl_sockets[fd] = std::move(s);
+    return fd;
+}
+
+int BotConnector::curl_close_socket(void *user, curl_socket_t fd)
+{
+    BotConnector *self = static_cast<BotConnector*>(user);
+    auto i = self->curl_sockets.find(fd);
+    if (i == self->curl_sockets.end()) {
+        return 1;
+    }
 
-    curl_easy_setopt(thread_curl, CURLOPT_WRITEDATA, &json_buffer);
-    curl_easy_setopt(thread_curl, CURLOPT_WRITEFUNCTION, json_writer);
-    CURLcode res = curl_easy_perform(thread_curl);
+    // Outstanding waits complete with operation_aborted
+    asio::error_code ec;
+    i->second->socket.close(ec);
+    self->curl_sockets.erase(i);
+    return 0;
+}
+
+int BotConnector::curl_socket_callback(CURL *, curl_socket_t fd, int what, void *user, void *)
+{
+    BotConnector *self = static_cast<BotConnector*>(user);
+    auto i = self->curl_sockets.find(fd);
+    if (i != self->curl_sockets.end()) {
+        i->second->want = what == CURL_POLL_REMOVE ? 0 : what;
+        self->wait_curl_socket(fd, *i->second);
+    }
+    return 0;
+}
+
+int BotConnector::curl_timer_callback(CURLM *, long timeout_msec, void *user)
+{
+    static_cast<BotConnector*>(user)->set_curl_timeout(timeout_msec);
+    return 0;
+}
+
+void BotConnector::wait_curl_socket(curl_socket_t fd, CurlSocket &s)
+{
+    // A wait that's no longer wanted can't be withdrawn on its own; it completes
+    // and is ignored, so at most one wait per direction is outstanding
+    if ((s.want & CURL_POLL_IN) && !s.waiting_in) {
+        s.waiting_in = true;
+        s.socket.async_wait(asio::ip::tcp::socket::wait_read, [=] (const asio::error_code &ec) {
+            on_curl_socket_ready(fd, CURL_CSELECT_IN, ec);
+        });
+    }
+    if ((s.want & CURL_POLL_OUT) && !s.waiting_out) {
+        s.waiting_out = true;
+        s.socket.async_wait(asio::ip::tcp::socket::wait_write, [=] (const asio::error_code &ec) {
+            on_curl_socket_ready(fd, CURL_CSELECT_OUT, ec);
+        });
+    }
+}
+
+void BotConnector::on_curl_socket_ready(curl_socket_t fd, int direction, asio::error_code const &ec)
+{
+    if (ec == asio::error::operation_aborted) {
+        return;
+    }
+    auto i = curl_sockets.find(fd);
+    if (i == curl_sockets.end()) {
+        return;
+    }
+
+    CurlSocket &s = *i->second;
+    if (direction == CURL_CSELECT_IN) {
+        s.waiting_in = false;
+    } else {
+        s.waiting_out = false;
+    }
+    if (!(s.want & direction)) {
+        return;
+    }
+
+    int running = 0;
+    curl_multi_socket_action(thread_curlm, fd, ec ? direction | CURL_CSELECT_ERR : direction, &running);
+    check_discovery_done();
+
+    // Curl may have closed the socket or changed what it waits for
+    i = curl_sockets.find(fd);
+    if (i != curl_sockets.end()) {
+        wait_curl_socket(fd, *i->second);
+    }
+}
+
+void BotConnector::set_curl_timeout(long timeout_msec)
+{
+    curl_timer->cancel();
+    if (timeout_msec < 0) {
+        return;
+    }
+
+    curl_timer->expires_from_now(std::chrono::milliseconds(timeout_msec));
+    curl_timer->async_wait([=] (const asio::error_code &ec) {
+        if (!ec) {
+            int running = 0;
+            curl_multi_socket_action(thread_curlm, CURL_SOCKET_TIMEOUT, 0, &running);
+            check_discovery_done();
+        }
+    });
+}
+
+void BotConnector::finish_discovery(CURLcode res)
+{
+    curl_multi_remove_handle(thread_curlm, thread_curl);
     curl_easy_setopt(thread_curl, CURLOPT_WRITEDATA, 0);
     curl_easy_setopt(thread_curl, CURLOPT_WRITEFUNCTION, 0);
+    discovery_active = false;
 
     if (res != CURLE_OK) {
         const char *err = curl_errbuf[0] ? curl_errbuf : curl_easy_strerror(res);
-        blog(LOG_ERROR, LOG_PREFIX "Failed to fetch %s, libcurl: %s", endpoint_url.c_str(), err);
-        return std::string();
+        blog(LOG_ERROR, LOG_PREFIX "Failed to fetch %s, libcurl: %s", discovery_url.c_str(), err);
+        async_reconnect();
+        return;
     }
 
     Document doc;
-    doc.ParseInsitu((char*) json_buffer.c_str());
+    doc.ParseInsitu((char*) discovery_buffer.c_str());
     std::string uri = json_str(doc, "uri");
+    if (uri.empty()) {
+        blog(LOG_ERROR, LOG_PREFIX "No websocket URI in response from %s", discovery_url.c_str());
+        async_reconnect();
+        return;
+    }
 
-    return uri;
+    connect_websocket(uri);
 }
 
 std::string BotConnector::parse_frontend_auth_key(std::string const &frontend_uri)
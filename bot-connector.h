@@ -3,15 +3,23 @@
 #include <websocketpp/common/thread.hpp>
 #include <websocketpp/common/asio.hpp>
 #include <websocketpp/common/thread.hpp>
-#include <websocketpp/config/asio_no_tls_client.hpp>
 #include <websocketpp/client.hpp>
 #include <curl/curl.h>
 #include <rapidjson/document.h>
-#include <rapidjson/stringbuffer.h>
 #include <functional>
+#include <map>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <random>
 #include <atomic>
+#include "message-pool.h"
+#include "outbound-queue.h"
+#include "vision-messages.h"
+#include "file-watcher.h"
+#include "websocket-config.h"
+#include "clock-sync.h"
+#include "overlay-scene-model.h"
 
 class BotConnector {
 public:
@@ -21,57 +29,185 @@ public:
     void set_connection_file_path(const char *path);
     std::string get_connection_file_path();
 
-    void send(rapidjson::StringBuffer* buffer);
+    void send(MessageBuffer* buffer, MessageKind kind = MessageKind::Generic, bool binary = false);
+    void send(RegionTrackingResult const &result, MessageBuilder &builder);
+    void send(ObjectDetectionResult const &result, MessageBuilder &builder);
+    OutboundQueue::Stats get_outbound_stats();
+    LatencyHistogram::Snapshot get_outbound_latency(MessageLane lane);
+    // Encoding vision results, and handing each frame to websocketpp. The latter
+    // covers copying, framing and queueing the frame, not the socket write itself.
+    LatencyHistogram::Snapshot get_serialize_latency();
+    LatencyHistogram::Snapshot get_enqueue_latency();
+
+    struct InboundStats {
+        uint64_t messages;
+        uint64_t scenes_applied;
+        uint64_t scenes_dropped;    // Superseded by a newer scene before being drawn
+        uint64_t deltas_applied;
+        uint64_t deltas_rejected;   // Base version didn't match; a full scene was requested
+        uint64_t deltas_superseded; // Came before a full scene in the same message, so skipped
+        uint64_t regions_dropped;
+        uint64_t bytes;             // Decompressed payload bytes
+        uint64_t parse_nsec;
+        bool compressed;            // permessage-deflate negotiated on the current connection
+    };
+    InboundStats get_inbound_stats();
+
+    // Controller clock, in seconds, at a local os_gettime_ns() time; 0 until synchronized
+    double controller_time(uint64_t local_nsec);
+    ClockSync::Stats get_clock_stats();
+
+    // Limits for combining queued messages into one websocket frame, once the server supports it
+    void set_batch_limits(uint32_t max_delay_usec, uint32_t max_bytes);
+    // Takes effect on the next connection
+    void set_compression(DeflateSettings const &settings);
     bool is_authenticated();
     bool poll_for_tracking_region_reset(double rect[4]);
 
-    std::function<void(rapidjson::Value const&)> on_camera_overlay_scene;
+    // Receives CameraOverlayScene contents as they are parsed. Set before connecting.
+    void set_overlay_sink(OverlaySceneSink *sink);
     std::function<void(rapidjson::Value const&)> on_camera_output_enable;
 
 private:
-    typedef websocketpp::client<websocketpp::config::asio_client> client_t;
-    typedef websocketpp::config::asio_client::message_type::ptr message_ptr;
+    typedef websocketpp::client<DeflateClientConfig> client_t;
+    typedef DeflateClientConfig::message_type::ptr message_ptr;
     typedef client_t::connection_ptr connection_ptr;
     typedef websocketpp::connection_hdl connection_hdl;
 
     bool authenticated;
     bool connected;
     bool can_send;
+    std::atomic<bool> binary_vision;
+    std::atomic<bool> batch_outbound;
+    std::atomic<uint32_t> batch_delay_usec;
+    std::atomic<uint32_t> batch_max_bytes;
     std::thread thread;
     client_t *thread_client;
     CURL *thread_curl;
+    CURLM *thread_curlm;
     char curl_errbuf[CURL_ERROR_SIZE];
+    bool discovery_active;
+    bool connecting;
+    bool restart_pending;
+    std::string discovery_url;
+    std::string discovery_buffer;
+
+    // Sockets curl opens for discovery are asio sockets, so the io thread can wait
+    // on them and only call into curl when one is ready or curl's timer expires.
+    struct CurlSocket {
+        CurlSocket(asio::io_service &io) : socket(io), want(0), waiting_in(false), waiting_out(false) {}
+        asio::ip::tcp::socket socket;
+        int want;               // CURL_POLL_* from the latest socket callback
+        bool waiting_in;
+        bool waiting_out;
+    };
+    std::map<curl_socket_t, std::unique_ptr<CurlSocket>> curl_sockets;
 
     std::string frontend_uri;
     std::string ws_uri;
+    std::string cached_ws_uri;  // Last address that accepted a connection, reused until it fails
     std::string auth_key;
 
+    unsigned reconnect_attempts;
+    uint64_t disconnected_at_nsec;
+    uint64_t last_reconnect_nsec;
+    std::minstd_rand reconnect_rng;
+
     asio::steady_timer *conn_timer;
+    asio::steady_timer *drain_timer;
+    asio::steady_timer *batch_timer;
+    asio::steady_timer *curl_timer;
+    asio::steady_timer *ping_timer;
+    ClockSync clock;
+    FileWatcher *conn_watcher;
+    std::string watched_path;
+    MessageBuilder io_builder;
+    MessageStringBuffer batch_text;
+    MessageStringBuffer batch_binary;
+    OutboundQueue outbound;
+    LatencyHistogram serialize_latency;
+    LatencyHistogram enqueue_latency;
+
     std::mutex conn_path_mutex;
     std::string conn_path;
 
+    std::mutex deflate_mutex;
+    DeflateSettings deflate_settings;
+
     double init_tracked_rect[4];
     std::atomic<bool> init_tracking_rect_flag;
 
+    struct {
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> scenes_applied{0};
+        std::atomic<uint64_t> scenes_dropped{0};
+        std::atomic<uint64_t> deltas_applied{0};
+        std::atomic<uint64_t> deltas_rejected{0};
+        std::atomic<uint64_t> deltas_superseded{0};
+        std::atomic<uint64_t> regions_dropped{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> parse_nsec{0};
+        std::atomic<bool> compressed{false};
+    } inbound_stats;
+
+    // Overlay scenes skip the DOM and are written into the sink during parsing.
+    // The last complete one waits there, unpublished, while 'scene_pending' is set.
+    uint64_t inbound_receive_nsec;
+    OverlaySceneSink *overlay_sink;
+    OverlaySceneParser scene_parser;
+    bool scene_pending;
+    bool full_scene_pending;
+    bool resync_requested;      // Until the next full scene
+    OverlaySceneDelta inbound_delta;
+
     connection_hdl active_conn;
-    void local_send(rapidjson::StringBuffer* buffer);
+    void local_send(MessageBuffer* buffer, bool binary = false);
+    void socket_send(const char *data, size_t size, bool binary);
+    void schedule_drain();
+    void drain_outbound();
+    bool send_batch(bool allow_bulk = true);
 
     void thread_func();
     void async_reconnect();
     void reconnect_handler();
-    bool try_reconnect();
+    unsigned next_reconnect_delay_msec();
+    void connect_websocket(std::string const &uri);
+    bool start_discovery();
+    void check_discovery_done();
+    void finish_discovery(CURLcode res);
+
+    static curl_socket_t curl_open_socket(void *user, curlsocktype purpose, struct curl_sockaddr *address);
+    static int curl_close_socket(void *user, curl_socket_t fd);
+    static int curl_socket_callback(CURL *easy, curl_socket_t fd, int what, void *user, void *socket_user);
+    static int curl_timer_callback(CURLM *multi, long timeout_msec, void *user);
+    void wait_curl_socket(curl_socket_t fd, CurlSocket &s);
+    void on_curl_socket_ready(curl_socket_t fd, int direction, asio::error_code const &ec);
+    void set_curl_timeout(long timeout_msec);
     void send_subscription();
+    void send_client_features();
 
     void on_socket_open(connection_hdl conn);
     void on_socket_close(connection_hdl conn);
+    void on_socket_fail(connection_hdl conn);
+    void on_socket_pong(connection_hdl conn, std::string payload);
+    void send_ping();
     void on_socket_message(connection_hdl conn, message_ptr msg);
-    void on_stream_message(rapidjson::Value const &msg, double timestamp);
+    void on_stream_batch(rapidjson::Value const &batch);
+    void on_stream_message(rapidjson::Value const &msg, bool newest_region, bool superseded_scene);
+    void on_binary_message(const uint8_t *data, size_t size);
+    void queue_overlay_scene(bool full_scene);
+    void apply_overlay_delta(OverlaySceneDelta const &delta);
+    void send_overlay_resync();
+    void apply_pending_scene();
     void on_auth_challenge(const char *challenge);
     void on_auth_status(bool status);
     void on_error_message(rapidjson::Value const &error);
+    void on_server_features(rapidjson::Value const &features);
     void on_camera_init_tracked_region(rapidjson::Value const &rect);
 
+    void watch_connection_file();
+    void on_connection_file_changed();
+    void restart_connection();
     std::string read_connection_frontend_uri();
-    std::string request_websocket_uri(std::string const &frontend_uri);
     std::string parse_frontend_auth_key(std::string const &frontend_uri);
 };
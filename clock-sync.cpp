@@ -0,0 +1,130 @@
+#include "clock-sync.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#define BUCKET_SEC              1.0
+#define MIN_BUCKETS_FOR_DRIFT   8
+#define MAX_DRIFT               500e-6
+#define RESYNC_THRESHOLD_SEC    1.0
+
+ClockSync::ClockSync()
+{
+    reset();
+}
+
+void ClockSync::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    memset(rtt, 0, sizeof rtt);
+    rtt_count = 0;
+    rtt_min = 0;
+    samples = 0;
+    reset_offset();
+}
+
+void ClockSync::reset_offset()
+{
+    bucket_count = 0;
+    current_valid = false;
+    synchronized = false;
+    fit_ref = fit_offset = fit_drift = 0.0;
+}
+
+void ClockSync::add_rtt_sample(uint64_t rtt_nsec)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    rtt[rtt_count++ % num_rtt] = rtt_nsec;
+
+    unsigned n = std::min(rtt_count, num_rtt);
+    rtt_min = *std::min_element(rtt, rtt + n);
+}
+
+void ClockSync::add_timestamp_sample(double controller_sec, uint64_t local_nsec)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double local_sec = local_nsec / 1e9;
+    double offset = controller_sec - local_sec;
+    samples++;
+
+    // A jump this large means the controller's clock was set or restarted
+    if (synchronized && fabs(offset - offset_at(local_sec)) > RESYNC_THRESHOLD_SEC) {
+        reset_offset();
+    }
+
+    if (current_valid && local_sec - current.local_sec >= BUCKET_SEC) {
+        commit_bucket();
+    }
+    if (!current_valid) {
+        current.local_sec = local_sec;
+        current.max_offset = offset;
+        current_valid = true;
+    } else {
+        current.max_offset = std::max(current.max_offset, offset);
+    }
+}
+
+void ClockSync::commit_bucket()
+{
+    buckets[bucket_count++ % num_buckets] = current;
+    current_valid = false;
+
+    unsigned n = std::min(bucket_count, num_buckets);
+    fit_ref = current.local_sec;
+
+    if (n < MIN_BUCKETS_FOR_DRIFT) {
+        // Too short to see drift; the least delayed bucket is the best estimate
+        fit_offset = buckets[0].max_offset;
+        for (unsigned i = 1; i < n; i++) {
+            fit_offset = std::max(fit_offset, buckets[i].max_offset);
+        }
+        fit_drift = 0.0;
+    } else {
+        double mean_x = 0.0, mean_y = 0.0;
+        for (unsigned i = 0; i < n; i++) {
+            mean_x += buckets[i].local_sec - fit_ref;
+            mean_y += buckets[i].max_offset;
+        }
+        mean_x /= n;
+        mean_y /= n;
+
+        double sxx = 0.0, sxy = 0.0;
+        for (unsigned i = 0; i < n; i++) {
+            double dx = buckets[i].local_sec - fit_ref - mean_x;
+            sxx += dx * dx;
+            sxy += dx * (buckets[i].max_offset - mean_y);
+        }
+        fit_drift = sxx > 0.0 ? std::max(-MAX_DRIFT, std::min(MAX_DRIFT, sxy / sxx)) : 0.0;
+        fit_offset = mean_y - fit_drift * mean_x;
+    }
+
+    synchronized = true;
+}
+
+double ClockSync::offset_at(double local_sec)
+{
+    return fit_offset + fit_drift * (local_sec - fit_ref) + rtt_min / 2e9;
+}
+
+double ClockSync::to_controller_time(uint64_t local_nsec)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!synchronized) {
+        return 0.0;
+    }
+    double local_sec = local_nsec / 1e9;
+    return local_sec + offset_at(local_sec);
+}
+
+ClockSync::Stats ClockSync::get_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.synchronized = synchronized;
+    stats.rtt_nsec = rtt_count ? rtt[(rtt_count - 1) % num_rtt] : 0;
+    stats.rtt_min_nsec = rtt_min;
+    stats.offset_sec = synchronized ? offset_at(current_valid ? current.local_sec : fit_ref) : 0.0;
+    stats.drift_ppm = fit_drift * 1e6;
+    stats.samples = samples;
+    return stats;
+}
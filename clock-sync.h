@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+
+// Relates our os_gettime_ns() clock to the bot controller's clock.
+//
+// Round trip times come from websocket pings. Offset samples come from the
+// timestamps on Stream messages: each one is the controller's clock minus our
+// receive time, which is the true offset less that message's one-way delay. The
+// largest sample in each one-second bucket is the least delayed, so we fit a line
+// through those bucket maxima to get offset and drift, then add half the minimum
+// RTT back as the estimated one-way delay, as NTP does.
+//
+// Samples are added from the websocket thread; conversions can happen anywhere.
+
+class ClockSync {
+public:
+    ClockSync();
+
+    void reset();
+    void add_rtt_sample(uint64_t rtt_nsec);
+    void add_timestamp_sample(double controller_sec, uint64_t local_nsec);
+
+    // Controller time in seconds for a local timestamp, or 0 if not synchronized yet
+    double to_controller_time(uint64_t local_nsec);
+
+    struct Stats {
+        bool synchronized;
+        uint64_t rtt_nsec;          // Most recent
+        uint64_t rtt_min_nsec;      // Over the last few pings
+        double offset_sec;          // Controller time minus local time, now
+        double drift_ppm;
+        uint64_t samples;
+    };
+    Stats get_stats();
+
+private:
+    static const unsigned num_rtt = 16;
+    static const unsigned num_buckets = 64;
+
+    struct Bucket {
+        double local_sec;
+        double max_offset;
+    };
+
+    std::mutex mutex;
+
+    uint64_t rtt[num_rtt];
+    unsigned rtt_count;
+    uint64_t rtt_min;
+
+    Bucket buckets[num_buckets];
+    unsigned bucket_count;
+    Bucket current;
+    bool current_valid;
+    uint64_t samples;
+
+    // offset(t) = fit_offset + fit_drift * (t - fit_ref)
+    bool synchronized;
+    double fit_ref;
+    double fit_offset;
+    double fit_drift;
+
+    void reset_offset();
+    void commit_bucket();
+    double offset_at(double local_sec);
+};
@@ -0,0 +1,280 @@
+#include "file-watcher.h"
+#include <obs-module.h>
+#include <string.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define LOG_PREFIX      "FileWatcher: "
+
+// Fallback only, when no change notification is available
+#define STAT_POLL_MSEC  1000
+
+FileWatcher::FileWatcher(asio::io_service &io, std::function<void()> on_change)
+    : on_change(on_change),
+      stat_timer(io)
+#ifdef __linux__
+      , inotify_stream(io),
+      watch_descriptor(-1),
+      reading(false)
+#endif
+#ifdef _WIN32
+      , dir_event(io),
+      dir_handle(INVALID_HANDLE_VALUE),
+      watch_serial(0)
+#endif
+{
+    memset(&last_stat, 0, sizeof last_stat);
+
+#ifdef _WIN32
+    memset(&overlapped, 0, sizeof overlapped);
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!overlapped.hEvent) {
+        blog(LOG_WARNING, LOG_PREFIX "Can't create event, polling instead");
+    } else {
+        dir_event.assign(overlapped.hEvent);
+    }
+#endif
+
+#ifdef __linux__
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        blog(LOG_WARNING, LOG_PREFIX "inotify unavailable, polling instead");
+    } else {
+        inotify_stream.assign(fd);
+    }
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+    cancel();
+}
+
+void FileWatcher::watch(std::string const &new_path)
+{
+    cancel();
+    path = new_path;
+
+    size_t slash = path.find_last_of("/\\");
+    if (slash == std::string::npos) {
+        dir_name = ".";
+        file_name = path;
+    } else {
+        dir_name = slash ? path.substr(0, slash) : "/";
+        file_name = path.substr(slash + 1);
+    }
+
+#ifdef __linux__
+    if (inotify_stream.is_open()) {
+        watch_descriptor = inotify_add_watch(inotify_stream.native_handle(), dir_name.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+        if (watch_descriptor >= 0) {
+            if (!reading) {
+                reading = true;
+                read_events();
+            }
+            return;
+        }
+        blog(LOG_WARNING, LOG_PREFIX "Can't watch %s, polling instead", dir_name.c_str());
+    }
+#endif
+
+#ifdef _WIN32
+    if (dir_event.is_open()) {
+        if (watch_directory()) {
+            return;
+        }
+        blog(LOG_WARNING, LOG_PREFIX "Can't watch %s, polling instead", dir_name.c_str());
+    }
+#endif
+
+    last_stat = stat_file();
+    poll_stat();
+}
+
+void FileWatcher::cancel()
+{
+    stat_timer.cancel();
+#ifdef __linux__
+    if (watch_descriptor >= 0) {
+        inotify_rm_watch(inotify_stream.native_handle(), watch_descriptor);
+        watch_descriptor = -1;
+    }
+#endif
+#ifdef _WIN32
+    close_directory();
+#endif
+}
+
+FileWatcher::FileStat FileWatcher::stat_file()
+{
+    FileStat result;
+    struct stat st;
+    memset(&result, 0, sizeof result);
+    if (!stat(path.c_str(), &st)) {
+        result.exists = true;
+        result.mtime = st.st_mtime;
+        result.size = st.st_size;
+    }
+    return result;
+}
+
+void FileWatcher::poll_stat()
+{
+    stat_timer.expires_from_now(std::chrono::milliseconds(STAT_POLL_MSEC));
+    stat_timer.async_wait([=] (const asio::error_code &ec) {
+        if (ec) {
+            return;
+        }
+        FileStat st = stat_file();
+        if (st != last_stat) {
+            last_stat = st;
+            on_change();
+        }
+        poll_stat();
+    });
+}
+
+#ifdef __linux__
+void FileWatcher::read_events()
+{
+    inotify_stream.async_read_some(asio::buffer(event_buffer), [=] (const asio::error_code &ec, size_t bytes) {
+        if (ec) {
+            if (ec != asio::error::operation_aborted) {
+                blog(LOG_ERROR, LOG_PREFIX "inotify read failed, %s", ec.message().c_str());
+            }
+            reading = false;
+            return;
+        }
+
+        bool changed = false;
+        size_t offset = 0;
+        while (offset + sizeof(struct inotify_event) <= bytes) {
+            const struct inotify_event *event = (const struct inotify_event*) (event_buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed = true;
+            } else if (event->wd == watch_descriptor && (event->mask & IN_IGNORED)) {
+                // The directory itself went away
+                watch_descriptor = -1;
+                last_stat = stat_file();
+                poll_stat();
+                changed = true;
+            } else if (event->wd == watch_descriptor && event->len && file_name == event->name) {
+                changed = true;
+            }
+        }
+
+        if (changed) {
+            on_change();
+        }
+        read_events();
+    });
+}
+#endif
+
+#ifdef _WIN32
+static std::wstring utf8_to_wide(std::string const &str)
+{
+    int len = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, NULL, 0);
+    if (len <= 0) {
+        return std::wstring();
+    }
+    std::vector<wchar_t> wide(len);
+    MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, wide.data(), len);
+    return std::wstring(wide.data());
+}
+
+bool FileWatcher::watch_directory()
+{
+    dir_handle = CreateFileW(utf8_to_wide(dir_name).c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dir_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    wide_file_name = utf8_to_wide(file_name);
+    return read_changes();
+}
+
+bool FileWatcher::read_changes()
+{
+    ResetEvent(overlapped.hEvent);
+    if (!ReadDirectoryChangesW(dir_handle, change_buffer, sizeof change_buffer, FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+            NULL, &overlapped, NULL)) {
+        CloseHandle(dir_handle);
+        dir_handle = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    unsigned serial = watch_serial;
+    dir_event.async_wait([=] (const asio::error_code &ec) {
+        if (ec || serial != watch_serial) {
+            // Cancelled, or a read issued before the last cancel()
+            return;
+        }
+
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(dir_handle, &overlapped, &bytes, FALSE)) {
+            // The directory itself went away, or the handle broke
+            blog(LOG_WARNING, LOG_PREFIX "Lost watch on %s (error %lu), polling instead",
+                dir_name.c_str(), GetLastError());
+            CloseHandle(dir_handle);
+            dir_handle = INVALID_HANDLE_VALUE;
+            last_stat = stat_file();
+            poll_stat();
+            on_change();
+            return;
+        }
+
+        // No bytes means the buffer overflowed and the changes were lost
+        bool changed = bytes == 0;
+        size_t offset = 0;
+        while (bytes && offset + sizeof(FILE_NOTIFY_INFORMATION) <= bytes) {
+            const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION*) (change_buffer + offset);
+            int len = (int) (info->FileNameLength / sizeof(WCHAR));
+            if (CompareStringOrdinal(info->FileName, len, wide_file_name.c_str(),
+                    (int) wide_file_name.size(), TRUE) == CSTR_EQUAL) {
+                changed = true;
+            }
+            if (!info->NextEntryOffset) {
+                break;
+            }
+            offset += info->NextEntryOffset;
+        }
+
+        // Listen again first; on_change() may replace the watch
+        if (!read_changes()) {
+            blog(LOG_WARNING, LOG_PREFIX "Can't keep watching %s, polling instead", dir_name.c_str());
+            last_stat = stat_file();
+            poll_stat();
+        }
+        if (changed) {
+            on_change();
+        }
+    });
+    return true;
+}
+
+void FileWatcher::close_directory()
+{
+    watch_serial++;
+    if (dir_handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    asio::error_code ec;
+    dir_event.cancel(ec);
+
+    // The kernel writes into change_buffer until the read is really cancelled
+    DWORD bytes;
+    CancelIoEx(dir_handle, &overlapped);
+    GetOverlappedResult(dir_handle, &overlapped, &bytes, TRUE);
+    CloseHandle(dir_handle);
+    dir_handle = INVALID_HANDLE_VALUE;
+}
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+#include <websocketpp/common/asio.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <functional>
+#include <string>
+
+// Calls on_change on the io_service thread when a file may have been created,
+// written, replaced or removed. This watches the containing directory, with inotify
+// on Linux and ReadDirectoryChangesW on Windows, so editors that save by renaming a
+// new file into place are seen too, and nothing touches the filesystem while the
+// file is left alone. Elsewhere, or if the directory can't be watched, it compares
+// stat() results on a timer.
+//
+// Not thread safe; use it only from the io_service thread.
+
+class FileWatcher {
+public:
+    FileWatcher(asio::io_service &io, std::function<void()> on_change);
+    ~FileWatcher();
+
+    void watch(std::string const &path);
+    void cancel();
+
+private:
+    struct FileStat {
+        bool exists;
+        time_t mtime;
+        off_t size;
+
+        bool operator!=(FileStat const &other) const {
+            return exists != other.exists || mtime != other.mtime || size != other.size;
+        }
+    };
+
+    std::function<void()> on_change;
+    std::string path;
+    std::string dir_name;
+    std::string file_name;
+
+    asio::steady_timer stat_timer;
+    FileStat last_stat;
+
+    FileStat stat_file();
+    void poll_stat();
+
+#ifdef __linux__
+    asio::posix::stream_descriptor inotify_stream;
+    int watch_descriptor;
+    bool reading;
+    alignas(8) char event_buffer[4096];
+
+    void read_events();
+#endif
+
+#ifdef _WIN32
+    asio::windows::object_handle dir_event;     // Owns overlapped.hEvent
+    HANDLE dir_handle;
+    OVERLAPPED overlapped;
+    std::wstring wide_file_name;
+    unsigned watch_serial;                      // Tells stale completions apart
+    alignas(8) char change_buffer[4096];
+
+    bool watch_directory();
+    bool read_changes();
+    void close_directory();
+#endif
+};
@@ -1,25 +1,78 @@
 #include "flyer-camera-filter.h"
 #include <obs-frontend-api.h>
 #include <algorithm>
+#include <math.h>
+#include <stdlib.h>
 #include <functional>
 #include <rapidjson/document.h>
-#include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
 
 using namespace rapidjson;
 
 #define S_CONNECTION_FILE_PATH      "connection_file_path"
 #define S_OVERLAY_TEXTURE_PATH      "overlay_texture_path"
+#define S_RECORD_TRACKER_FRAMES     "record_tracker_frames"
+#define S_RECORDING_DIRECTORY       "recording_directory"
+#define S_TRACKER_FRAME_BUDGET      "tracker_frame_budget_ms"
+#define S_VISION_THREADS            "vision_threads"
+#define S_VISION_PIN_THREADS        "vision_pin_threads"
+#define S_VISION_LOW_PRIORITY       "vision_low_priority"
+#define S_BATCH_MAX_DELAY           "batch_max_delay_ms"
+#define S_BATCH_MAX_SIZE            "batch_max_size_kb"
+#define S_COMPRESSION               "compression"
+#define S_COMPRESSION_NO_CONTEXT    "compression_no_context_takeover"
+#define S_COMPRESSION_WINDOW_BITS   "compression_window_bits"
+#define S_LOCAL_TRACKED             "local_overlay_tracked"
+#define S_LOCAL_DETECTED            "local_overlay_detected"
+#define S_LOCAL_TRACKED_COLOR       "local_overlay_tracked_color"
+#define S_LOCAL_DETECTED_COLOR      "local_overlay_detected_color"
+#define S_LOCAL_LINE_WIDTH          "local_overlay_line_width"
+#define S_LOCAL_MIN_PROB            "local_overlay_min_prob"
+#define S_PIPELINE_STATS            "pipeline_stats"
+#define S_PIPELINE_STATS_REFRESH    "pipeline_stats_refresh"
 
 #define T_CONNECTION_FILE_PATH          obs_module_text("Controller \"connection.txt\" file")
 #define T_CONNECTION_FILE_PATH_FILTER   "Connection info (*.txt);;All files (*.*)"
 #define T_OVERLAY_TEXTURE_PATH          obs_module_text("Controller \"overlay.png\" file")
 #define T_OVERLAY_TEXTURE_PATH_FILTER   "Texture (*.png);;All files (*.*)"
+#define T_RECORD_TRACKER_FRAMES         obs_module_text("Record tracker frames")
+#define T_RECORDING_DIRECTORY           obs_module_text("Frame recording directory")
+#define T_TRACKER_FRAME_BUDGET          obs_module_text("Tracker CPU budget per frame (ms)")
+#define T_BATCH_MAX_DELAY               obs_module_text("Outbound batch max delay (ms)")
+#define T_BATCH_MAX_SIZE                obs_module_text("Outbound batch max size (KB)")
+#define T_COMPRESSION                   obs_module_text("Request websocket compression")
+#define T_COMPRESSION_NO_CONTEXT        obs_module_text("Compress each message independently")
+#define T_COMPRESSION_WINDOW_BITS       obs_module_text("Compression window (bits)")
+#define T_VISION_THREADS                obs_module_text("Vision worker threads, shared by all cameras (0 = half the cores)")
+#define T_VISION_PIN_THREADS            obs_module_text("Pin vision workers to cores")
+#define T_VISION_LOW_PRIORITY           obs_module_text("Run vision workers below normal priority")
+#define T_LOCAL_TRACKED                 obs_module_text("Draw tracked region locally")
+#define T_LOCAL_DETECTED                obs_module_text("Draw detected objects locally")
+#define T_LOCAL_TRACKED_COLOR           obs_module_text("Tracked region color")
+#define T_LOCAL_DETECTED_COLOR          obs_module_text("Detected object color")
+#define T_LOCAL_LINE_WIDTH              obs_module_text("Local box line width (px)")
+#define T_LOCAL_MIN_PROB                obs_module_text("Minimum detection probability")
+#define T_PIPELINE_STATS                obs_module_text("Pipeline statistics since startup")
+#define T_PIPELINE_STATS_REFRESH        obs_module_text("Refresh statistics")
 
 #define S_LOCAL_RECORDING               "LocalRecording"
 #define S_LIVE_STREAM                   "LiveStream"
+#define S_LINK                          "Link"
 
+// Outputs are sampled often, but status is only sent when something moved
+// past a threshold, or as a heartbeat
 #define CAMERA_OUTPUT_STATUS_INTERVAL   0.2
+#define CAMERA_OUTPUT_HEARTBEAT         2.0
+#define CONGESTION_THRESHOLD            0.05
+#define DROPPED_FRAMES_THRESHOLD        10
+#define PIPELINE_STATS_INTERVAL         5.0
+#define DEFAULT_TRACKER_FRAME_BUDGET    4.0
+#define DEFAULT_BATCH_MAX_DELAY         0.0
+#define DEFAULT_BATCH_MAX_SIZE          64
+#define DEFAULT_COMPRESSION_WINDOW_BITS 15
+#define DEFAULT_LOCAL_TRACKED_COLOR     0xff40ff40
+#define DEFAULT_LOCAL_DETECTED_COLOR    0xff00c0ff
+#define DEFAULT_LOCAL_LINE_WIDTH        3.0
+#define DEFAULT_LOCAL_MIN_PROB          0.4
 
 static void output_timer_tick(obs_output_t* output, float tick_seconds, double* pTimer)
 {
@@ -30,48 +83,117 @@ static void output_timer_tick(obs_output_t* output, float tick_seconds, double*
     }
 }
 
-template <typename Allocator>
-static Value output_status(obs_output_t* output, double timer, Allocator &alloc)
+static void sample_output(obs_output_t* output, OutputStatus &status)
 {
-    Value id;
-    id.SetString(output ? obs_output_get_id(output) : "", alloc);
+    status = OutputStatus();
+    if (output) {
+        status.id = obs_output_get_id(output);
+        status.reconnecting = obs_output_reconnecting(output);
+        status.congestion = obs_output_get_congestion(output);
+        status.total_bytes = obs_output_get_total_bytes(output);
+        status.total_frames = obs_output_get_total_frames(output);
+        status.frames_dropped = obs_output_get_frames_dropped(output);
+        if (obs_output_active(output)) {
+            status.active = true;
+            status.width = obs_output_get_width(output);
+            status.height = obs_output_get_height(output);
+        }
+    }
+}
 
-    uint32_t width = 0, height = 0;
-    bool active = false;
+// Counters and timers that always move aren't compared; they ride along with the next message
+static bool output_changed(OutputStatus const &sent, OutputStatus const &sample)
+{
+    return sent.id != sample.id ||
+        sent.active != sample.active ||
+        sent.reconnecting != sample.reconnecting ||
+        sent.width != sample.width ||
+        sent.height != sample.height ||
+        fabs(sent.congestion - sample.congestion) >= CONGESTION_THRESHOLD ||
+        abs(sample.frames_dropped - sent.frames_dropped) >= DROPPED_FRAMES_THRESHOLD;
+}
 
-    if (output && obs_output_active(output)) {
-        active = true;
-        width = obs_output_get_width(output);
-        height = obs_output_get_height(output);
-    }
+static MessageValue output_status(OutputStatus const &status, double timer, MessageAllocator &alloc)
+{
+    MessageValue id;
+    id.SetString(status.id.c_str(), (SizeType) status.id.size(), alloc);
 
-    Value obj;
+    MessageValue obj;
     obj.SetObject();
-    obj.AddMember("active", active, alloc);
-    obj.AddMember("reconnecting", output ? obs_output_reconnecting(output) : false, alloc);
+    obj.AddMember("active", status.active, alloc);
+    obj.AddMember("reconnecting", status.reconnecting, alloc);
     obj.AddMember("id", id, alloc);
-    obj.AddMember("width", width, alloc);
-    obj.AddMember("height", height, alloc);
-    obj.AddMember("congestion", output ? obs_output_get_congestion(output) : 0.0f, alloc);
-    obj.AddMember("total_bytes", output ? obs_output_get_total_bytes(output) : 0, alloc);
-    obj.AddMember("total_frames", output ? obs_output_get_total_frames(output) : 0, alloc);
-    obj.AddMember("frames_dropped", output ? obs_output_get_frames_dropped(output) : 0, alloc);
+    obj.AddMember("width", status.width, alloc);
+    obj.AddMember("height", status.height, alloc);
+    obj.AddMember("congestion", status.congestion, alloc);
+    obj.AddMember("total_bytes", status.total_bytes, alloc);
+    obj.AddMember("total_frames", status.total_frames, alloc);
+    obj.AddMember("frames_dropped", status.frames_dropped, alloc);
     obj.AddMember("active_seconds", timer, alloc);
     return obj;
 }
 
+static MessageValue link_status(ClockSync::Stats const &clock, MessageAllocator &alloc)
+{
+    MessageValue obj;
+    obj.SetObject();
+    obj.AddMember("clock_synchronized", clock.synchronized, alloc);
+    obj.AddMember("rtt_msec", clock.rtt_nsec / 1e6, alloc);
+    obj.AddMember("rtt_min_msec", clock.rtt_min_nsec / 1e6, alloc);
+    obj.AddMember("clock_offset", clock.offset_sec, alloc);
+    obj.AddMember("clock_drift_ppm", clock.drift_ppm, alloc);
+    return obj;
+}
+
 FlyerCameraFilter::FlyerCameraFilter(obs_source_t* source)
     : source(source),
       grabber_detector(fmt_detector),
       grabber_tracker(fmt_tracker),
-      vision_detector(&grabber_detector, &bot),
-      vision_tracker(&grabber_tracker, &bot),
+      vision_detector(&grabber_detector, &bot, &overlay),
+      vision_tracker(&grabber_tracker, &bot, &recorder_tracker, &overlay),
       camera_output_status_timer(0.0f),
+      camera_output_heartbeat_timer(0.0f),
+      pipeline_stats_timer(0.0f),
       streaming_active_timer(0.0),
-      recording_active_timer(0.0)
+      recording_active_timer(0.0),
+      streaming_status(),
+      recording_status(),
+      clock_synchronized_status(false),
+      camera_output_status_sent(false),
+      camera_output_status_dirty(false),
+      pipeline_stats(grabber_tracker, grabber_detector, vision_tracker, vision_detector, bot)
 {
-    bot.on_camera_overlay_scene = std::bind(&OverlayDrawing::update_scene, &overlay, std::placeholders::_1);
+    bot.set_overlay_sink(&overlay);
     bot.on_camera_output_enable = std::bind(&FlyerCameraFilter::camera_output_enable, this, std::placeholders::_1);
+    obs_frontend_add_event_callback(frontend_event, this);
+}
+
+FlyerCameraFilter::~FlyerCameraFilter()
+{
+    obs_frontend_remove_event_callback(frontend_event, this);
+
+    // Runs still in flight use the overlay, the bot and the grabbers
+    vision_detector.stop();
+    vision_tracker.stop();
+}
+
+void FlyerCameraFilter::frontend_event(enum obs_frontend_event event, void *filter)
+{
+    switch (event) {
+    case OBS_FRONTEND_EVENT_STREAMING_STARTING:
+    case OBS_FRONTEND_EVENT_STREAMING_STARTED:
+    case OBS_FRONTEND_EVENT_STREAMING_STOPPING:
+    case OBS_FRONTEND_EVENT_STREAMING_STOPPED:
+    case OBS_FRONTEND_EVENT_RECORDING_STARTING:
+    case OBS_FRONTEND_EVENT_RECORDING_STARTED:
+    case OBS_FRONTEND_EVENT_RECORDING_STOPPING:
+    case OBS_FRONTEND_EVENT_RECORDING_STOPPED:
+        // Sampled on the next tick rather than waiting out the interval
+        static_cast<FlyerCameraFilter*>(filter)->camera_output_status_dirty = true;
+        break;
+    default:
+        break;
+    }
 }
 
 obs_properties_t* FlyerCameraFilter::get_properties()
@@ -84,6 +206,38 @@ obs_properties_t* FlyerCameraFilter::get_properties()
     obs_properties_add_path(props, S_OVERLAY_TEXTURE_PATH, T_OVERLAY_TEXTURE_PATH, OBS_PATH_FILE,
         T_OVERLAY_TEXTURE_PATH_FILTER, overlay_texture_path.c_str());
 
+    obs_properties_add_float(props, S_TRACKER_FRAME_BUDGET, T_TRACKER_FRAME_BUDGET, 0.0, 100.0, 0.5);
+
+    obs_properties_add_int(props, S_VISION_THREADS, T_VISION_THREADS, 0, 64, 1);
+    obs_properties_add_bool(props, S_VISION_PIN_THREADS, T_VISION_PIN_THREADS);
+    obs_properties_add_bool(props, S_VISION_LOW_PRIORITY, T_VISION_LOW_PRIORITY);
+
+    obs_properties_add_float(props, S_BATCH_MAX_DELAY, T_BATCH_MAX_DELAY, 0.0, 50.0, 0.5);
+    obs_properties_add_int(props, S_BATCH_MAX_SIZE, T_BATCH_MAX_SIZE, 1, 4096, 1);
+
+    obs_properties_add_bool(props, S_COMPRESSION, T_COMPRESSION);
+    obs_properties_add_bool(props, S_COMPRESSION_NO_CONTEXT, T_COMPRESSION_NO_CONTEXT);
+    obs_properties_add_int(props, S_COMPRESSION_WINDOW_BITS, T_COMPRESSION_WINDOW_BITS, 9, 15, 1);
+
+    obs_properties_add_bool(props, S_LOCAL_TRACKED, T_LOCAL_TRACKED);
+    obs_properties_add_color(props, S_LOCAL_TRACKED_COLOR, T_LOCAL_TRACKED_COLOR);
+    obs_properties_add_bool(props, S_LOCAL_DETECTED, T_LOCAL_DETECTED);
+    obs_properties_add_color(props, S_LOCAL_DETECTED_COLOR, T_LOCAL_DETECTED_COLOR);
+    obs_properties_add_float(props, S_LOCAL_LINE_WIDTH, T_LOCAL_LINE_WIDTH, 0.5, 32.0, 0.5);
+    obs_properties_add_float(props, S_LOCAL_MIN_PROB, T_LOCAL_MIN_PROB, 0.0, 1.0, 0.05);
+
+    obs_properties_add_bool(props, S_RECORD_TRACKER_FRAMES, T_RECORD_TRACKER_FRAMES);
+
+    obs_properties_add_path(props, S_RECORDING_DIRECTORY, T_RECORDING_DIRECTORY, OBS_PATH_DIRECTORY,
+        NULL, recording_directory.c_str());
+
+    // An info label rather than a text field, so it never ends up in the saved
+    // settings. Refresh returns true, which rebuilds the properties with new text.
+    std::string stats_text = std::string(T_PIPELINE_STATS) + "\n" + pipeline_stats.format_totals();
+    obs_properties_add_text(props, S_PIPELINE_STATS, stats_text.c_str(), OBS_TEXT_INFO);
+    obs_properties_add_button(props, S_PIPELINE_STATS_REFRESH, T_PIPELINE_STATS_REFRESH,
+        [] (obs_properties_t*, obs_property_t*, void*) { return true; });
+
     return props;
 }
 
@@ -91,9 +245,56 @@ void FlyerCameraFilter::update(obs_data_t* settings)
 {
     connection_file_path = obs_data_get_string(settings, S_CONNECTION_FILE_PATH);
     overlay_texture_path = obs_data_get_string(settings, S_OVERLAY_TEXTURE_PATH);
+    recording_directory = obs_data_get_string(settings, S_RECORDING_DIRECTORY);
 
     bot.set_connection_file_path(connection_file_path.c_str());
     overlay.set_texture_file_path(overlay_texture_path.c_str());
+    recorder_tracker.set_directory(recording_directory.c_str());
+    recorder_tracker.set_enabled(obs_data_get_bool(settings, S_RECORD_TRACKER_FRAMES));
+    vision_tracker.set_frame_budget_nsec((uint64_t)(obs_data_get_double(settings, S_TRACKER_FRAME_BUDGET) * 1e6));
+
+    // The pool is process-wide; the most recently updated filter's settings win
+    TaskPool::Settings pool;
+    pool.max_threads = (unsigned) obs_data_get_int(settings, S_VISION_THREADS);
+    pool.pin_threads = obs_data_get_bool(settings, S_VISION_PIN_THREADS);
+    pool.low_priority = obs_data_get_bool(settings, S_VISION_LOW_PRIORITY);
+    TaskPool::get().configure(pool);
+    bot.set_batch_limits((uint32_t)(obs_data_get_double(settings, S_BATCH_MAX_DELAY) * 1e3),
+        (uint32_t) obs_data_get_int(settings, S_BATCH_MAX_SIZE) * 1024);
+
+    DeflateSettings deflate;
+    deflate.enabled = obs_data_get_bool(settings, S_COMPRESSION);
+    deflate.no_context_takeover = obs_data_get_bool(settings, S_COMPRESSION_NO_CONTEXT);
+    deflate.max_window_bits = (uint8_t) obs_data_get_int(settings, S_COMPRESSION_WINDOW_BITS);
+    bot.set_compression(deflate);
+
+    // Color properties have no alpha; the boxes are always opaque
+    LocalOverlayStyle style;
+    style.show_tracked = obs_data_get_bool(settings, S_LOCAL_TRACKED);
+    style.show_detected = obs_data_get_bool(settings, S_LOCAL_DETECTED);
+    style.tracked_color = (uint32_t) obs_data_get_int(settings, S_LOCAL_TRACKED_COLOR) | 0xff000000;
+    style.detected_color = (uint32_t) obs_data_get_int(settings, S_LOCAL_DETECTED_COLOR) | 0xff000000;
+    style.line_width_px = obs_data_get_double(settings, S_LOCAL_LINE_WIDTH);
+    style.min_prob = obs_data_get_double(settings, S_LOCAL_MIN_PROB);
+    overlay.set_local_style(style);
+}
+
+void FlyerCameraFilter::get_defaults(obs_data_t* settings)
+{
+    obs_data_set_default_double(settings, S_TRACKER_FRAME_BUDGET, DEFAULT_TRACKER_FRAME_BUDGET);
+    obs_data_set_default_int(settings, S_VISION_THREADS, 0);
+    obs_data_set_default_bool(settings, S_VISION_PIN_THREADS, false);
+    obs_data_set_default_bool(settings, S_VISION_LOW_PRIORITY, true);
+    obs_data_set_default_double(settings, S_BATCH_MAX_DELAY, DEFAULT_BATCH_MAX_DELAY);
+    obs_data_set_default_int(settings, S_BATCH_MAX_SIZE, DEFAULT_BATCH_MAX_SIZE);
+    obs_data_set_default_bool(settings, S_COMPRESSION, false);
+    obs_data_set_default_int(settings, S_COMPRESSION_WINDOW_BITS, DEFAULT_COMPRESSION_WINDOW_BITS);
+    obs_data_set_default_bool(settings, S_LOCAL_TRACKED, true);
+    obs_data_set_default_bool(settings, S_LOCAL_DETECTED, false);
+    obs_data_set_default_int(settings, S_LOCAL_TRACKED_COLOR, DEFAULT_LOCAL_TRACKED_COLOR);
+    obs_data_set_default_int(settings, S_LOCAL_DETECTED_COLOR, DEFAULT_LOCAL_DETECTED_COLOR);
+    obs_data_set_default_double(settings, S_LOCAL_LINE_WIDTH, DEFAULT_LOCAL_LINE_WIDTH);
+    obs_data_set_default_double(settings, S_LOCAL_MIN_PROB, DEFAULT_LOCAL_MIN_PROB);
 }
 
 void FlyerCameraFilter::video_tick(float seconds)
@@ -101,17 +302,26 @@ void FlyerCameraFilter::video_tick(float seconds)
     grabber_tracker.tick();
     grabber_detector.tick();
 
-    camera_output_status_timer += seconds;
-    if (camera_output_status_timer > CAMERA_OUTPUT_STATUS_INTERVAL) {
-        camera_output_status_timer -= CAMERA_OUTPUT_STATUS_INTERVAL;
-        if (camera_output_status_timer > CAMERA_OUTPUT_STATUS_INTERVAL) {
-            camera_output_status_timer = 0.0f;
-        }
-        send_camera_output_status();
+    obs_output_t* recording = obs_frontend_get_recording_output();
+    obs_output_t* streaming = obs_frontend_get_streaming_output();
+    output_timer_tick(recording, seconds, &recording_active_timer);
+    output_timer_tick(streaming, seconds, &streaming_active_timer);
+    obs_output_release(recording);
+    obs_output_release(streaming);
+
+    pipeline_stats_timer += seconds;
+    if (pipeline_stats_timer > PIPELINE_STATS_INTERVAL) {
+        pipeline_stats_timer = 0.0f;
+        send_pipeline_stats();
     }
 
-    output_timer_tick(obs_frontend_get_recording_output(), seconds, &recording_active_timer);
-    output_timer_tick(obs_frontend_get_streaming_output(), seconds, &streaming_active_timer);
+    bool dirty = camera_output_status_dirty.exchange(false);
+    camera_output_heartbeat_timer += seconds;
+    camera_output_status_timer += seconds;
+    if (dirty || camera_output_status_timer > CAMERA_OUTPUT_STATUS_INTERVAL) {
+        camera_output_status_timer = 0.0f;
+        update_camera_output_status();
+    }
 }
 
 void FlyerCameraFilter::video_render(gs_effect* effect)
@@ -154,28 +364,76 @@ void FlyerCameraFilter::camera_output_enable(rapidjson::Value const &cmd)
     }
 }
 
-void FlyerCameraFilter::send_camera_output_status()
+void FlyerCameraFilter::update_camera_output_status()
 {
-    Document d;
-    d.SetObject();
+    if (!bot.is_authenticated()) {
+        // Nothing to compare against once a new controller connects
+        camera_output_status_sent = false;
+        return;
+    }
 
+    OutputStatus recording_sample, streaming_sample;
     obs_output_t* recording = obs_frontend_get_recording_output();
     obs_output_t* streaming = obs_frontend_get_streaming_output();
+    sample_output(recording, recording_sample);
+    sample_output(streaming, streaming_sample);
+    obs_output_release(recording);
+    obs_output_release(streaming);
+    bool clock_synchronized = bot.get_clock_stats().synchronized;
+
+    bool changed = !camera_output_status_sent ||
+        camera_output_heartbeat_timer >= CAMERA_OUTPUT_HEARTBEAT ||
+        clock_synchronized != clock_synchronized_status ||
+        output_changed(recording_status, recording_sample) ||
+        output_changed(streaming_status, streaming_sample);
+
+    if (changed) {
+        recording_status = recording_sample;
+        streaming_status = streaming_sample;
+        clock_synchronized_status = clock_synchronized;
+        camera_output_status_sent = true;
+        camera_output_heartbeat_timer = 0.0f;
+        send_camera_output_status();
+    }
+}
 
-    Value obj;
+void FlyerCameraFilter::send_camera_output_status()
+{
+    MessageDocument &d = status_builder.begin();
+
+    MessageValue obj;
     obj.SetObject();
-    obj.AddMember(S_LOCAL_RECORDING, output_status(recording, recording_active_timer, d.GetAllocator()), d.GetAllocator());
-    obj.AddMember(S_LIVE_STREAM, output_status(streaming, streaming_active_timer, d.GetAllocator()), d.GetAllocator());
+    obj.AddMember(S_LOCAL_RECORDING, output_status(recording_status, recording_active_timer, d.GetAllocator()), d.GetAllocator());
+    obj.AddMember(S_LIVE_STREAM, output_status(streaming_status, streaming_active_timer, d.GetAllocator()), d.GetAllocator());
+    obj.AddMember(S_LINK, link_status(bot.get_clock_stats(), d.GetAllocator()), d.GetAllocator());
 
-    Value cmd;
+    MessageValue cmd;
     cmd.SetObject();
     cmd.AddMember("CameraOutputStatus", obj, d.GetAllocator());
     d.AddMember("Command", cmd, d.GetAllocator());
 
-    StringBuffer *buffer = new StringBuffer();
-    Writer<StringBuffer> writer(*buffer);
-    d.Accept(writer);
-    bot.send(buffer);
+    bot.send(status_builder.finish(), MessageKind::CameraOutputStatus);
+}
+
+void FlyerCameraFilter::send_pipeline_stats()
+{
+    // Intervals keep running while disconnected, so the first report after
+    // connecting covers the whole gap
+    if (!bot.is_authenticated()) {
+        return;
+    }
+
+    MessageDocument &d = status_builder.begin();
+
+    MessageValue obj;
+    pipeline_stats.encode_interval(obj, d.GetAllocator());
+
+    MessageValue cmd;
+    cmd.SetObject();
+    cmd.AddMember("CameraPipelineStats", obj, d.GetAllocator());
+    d.AddMember("Command", cmd, d.GetAllocator());
+
+    bot.send(status_builder.finish(), MessageKind::CameraPipelineStats);
 }
 
 void FlyerCameraFilter::module_load() {
@@ -210,6 +468,10 @@ void FlyerCameraFilter::module_load() {
         static_cast<FlyerCameraFilter*>(filter)->update(settings);
 	};
 
+    info.get_defaults = [] (obs_data_t* settings) {
+        FlyerCameraFilter::get_defaults(settings);
+    };
+
     info.get_properties = [] (void* filter) {
         return static_cast<FlyerCameraFilter*>(filter)->get_properties();
 	};
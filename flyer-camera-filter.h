@@ -1,18 +1,37 @@
 #pragma once
 #include <obs-module.h>
+#include <obs-frontend-api.h>
 #include <vector>
 #include <string>
+#include <atomic>
 #include "bot-connector.h"
 #include "image-grabber.h"
+#include "frame-recorder.h"
 #include "flyer-vision-tracker.h"
 #include "flyer-vision-detector.h"
 #include "overlay-drawing.h"
+#include "pipeline-stats.h"
+
+// One sample of an output's status, as reported in CameraOutputStatus
+struct OutputStatus {
+    std::string id;
+    bool active;
+    bool reconnecting;
+    uint32_t width;
+    uint32_t height;
+    float congestion;
+    uint64_t total_bytes;
+    int total_frames;
+    int frames_dropped;
+};
 
 class FlyerCameraFilter {
 public:
     FlyerCameraFilter(obs_source_t* source);
+    ~FlyerCameraFilter();
 
     static void module_load();
+    static void get_defaults(obs_data_t* settings);
 
     void video_tick(float seconds);
     void video_render(gs_effect* effect);
@@ -22,23 +41,39 @@ public:
 private:
     obs_source_t        *source;
 
+    // Vision tasks send results to these, so they are declared first and outlive them
+    OverlayDrawing      overlay;
+    MessageBuilder      status_builder;
+    BotConnector        bot;
+
     DetectorImageFormatter  fmt_detector;
     TrackerImageFormatter   fmt_tracker;
     ImageGrabber            grabber_detector;
     ImageGrabber            grabber_tracker;
+    FrameRecorder           recorder_tracker;
     FlyerVisionDetector     vision_detector;
     FlyerVisionTracker      vision_tracker;
 
     float                   camera_output_status_timer;
+    float                   camera_output_heartbeat_timer;
+    float                   pipeline_stats_timer;
     double                  streaming_active_timer;
     double                  recording_active_timer;
+    OutputStatus            streaming_status;   // As last sent
+    OutputStatus            recording_status;
+    bool                    clock_synchronized_status;
+    bool                    camera_output_status_sent;  // Since the controller last authenticated
+    std::atomic<bool>       camera_output_status_dirty;
 
-    OverlayDrawing      overlay;
-    BotConnector        bot;
+    PipelineStats       pipeline_stats;
 
     std::string         connection_file_path;
     std::string         overlay_texture_path;
+    std::string         recording_directory;
 
     void camera_output_enable(rapidjson::Value const &scene);
+    static void frontend_event(enum obs_frontend_event event, void *filter);
+    void update_camera_output_status();
     void send_camera_output_status();
+    void send_pipeline_stats();
 };
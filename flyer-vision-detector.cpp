@@ -1,22 +1,35 @@
 #include "flyer-vision-detector.h"
 #include "yolo/yolo_v2_class.hpp"
+#include "vision-messages.h"
 #include "util/platform.h"
-#include <rapidjson/document.h>
-#include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
 
-using namespace rapidjson;
-
-FlyerVisionDetector::FlyerVisionDetector(ImageGrabber *source, BotConnector *bot)
-    : request_exit(false), source(source), bot(bot)
+FlyerVisionDetector::FlyerVisionDetector(ImageGrabber *source, BotConnector *bot, OverlayDrawing *overlay)
+    : source(source), bot(bot), overlay(overlay), task([this] () { run(); })
 {
-    start();
+    frame.counter = 0;
+    source->set_frame_listener(&task);
+
+    // Loading the network takes a while; get it done before the first frame
+    task.trigger();
 }
 
 FlyerVisionDetector::~FlyerVisionDetector()
 {
-    request_exit.store(true);
-    thread.join();
+    stop();
+    if (yolo) {
+        blog(LOG_INFO, "YOLO detector exiting");
+    }
+}
+
+void FlyerVisionDetector::stop()
+{
+    source->set_frame_listener(NULL);
+    task.stop();
+}
+
+LatencyHistogram::Snapshot FlyerVisionDetector::get_inference_latency()
+{
+    return inference_latency.snapshot();
 }
 
 std::vector<std::string> FlyerVisionDetector::load_names(const char* filename)
@@ -39,99 +52,67 @@ std::vector<std::string> FlyerVisionDetector::load_names(const char* filename)
     return names;
 }
 
-void FlyerVisionDetector::start()
+void FlyerVisionDetector::run()
 {
-    thread = std::thread([=] () { thread_func(); });
-}
+    if (!yolo) {
+        blog(LOG_INFO, "YOLO detector starting up...");
 
-void FlyerVisionDetector::thread_func()
-{
-    std::vector<bbox_t> boxes;
-    ImageGrabber::Frame frame;
-    frame.counter = 0;
+        names = load_names(obs_module_file("coco.names"));
+        yolo.reset(new Detector(obs_module_file("yolo.cfg"),
+                                obs_module_file("yolo.weights")));
 
-    blog(LOG_INFO, "YOLO detector starting up...");
+        blog(LOG_INFO, "YOLO detector running");
+    }
 
-    std::vector<std::string> names = load_names(obs_module_file("coco.names"));
-    Detector yolo(obs_module_file("yolo.cfg"),
-                  obs_module_file("yolo.weights"));
+    if (!source->get_frame_after(frame.counter, frame)) {
+        return;
+    }
 
-    blog(LOG_INFO, "YOLO detector running");
-    while (!request_exit.load()) {
-        if (!source->wait_for_frame(frame.counter)) {
-            continue;
-        }
-        frame = source->get_latest_frame();
-
-        image_t yolo_img = {};
-        yolo_img.w = frame.width;
-        yolo_img.h = frame.height;
-        yolo_img.c = 3;
-        yolo_img.data = static_cast<float*>(frame.image);
-
-        // Input coordinate system is relative to (squished) image provided to neural net;
-        // output coordinate system should match the overlay rendering, with [0,0] in the
-        // center, aspect correct, and horizontal extents from [-1,+1].
-
-        double x_scale = 2.0 / frame.width;
-        double aspect = frame.source_width ? frame.source_height / (double) frame.source_width : 0.0;
-        double y_scale = x_scale * aspect;
-
-        double center_x = frame.width / 2.0;
-        double center_y = frame.height / 2.0;
-
-        uint64_t timestamp_1 = os_gettime_ns();
-        boxes = yolo.detect(yolo_img, 0.1);
-        uint64_t timestamp_2 = os_gettime_ns();
-
-        if (bot->is_authenticated()) {
-            Document d;
-            d.SetObject();
-            Value arr;
-            arr.SetArray();
-
-            for (int n = 0; n < boxes.size(); n++) {
-                bbox_t &box = boxes[n];
-
-                const char *label = "";
-                if (box.obj_id < names.size()) {
-                    label = names[box.obj_id].c_str();
-                }
-
-                Value rect;
-                rect.SetArray();
-                rect.PushBack(Value(x_scale * (box.x - center_x)), d.GetAllocator());
-                rect.PushBack(Value(y_scale * (box.y - center_y)), d.GetAllocator());
-                rect.PushBack(Value(x_scale * box.w), d.GetAllocator());
-                rect.PushBack(Value(y_scale * box.h), d.GetAllocator());
-
-                Value obj;
-                obj.SetObject();
-                obj.AddMember("rect", rect, d.GetAllocator());
-                obj.AddMember("prob", Value(box.prob), d.GetAllocator());
-                obj.AddMember("label", StringRef(label), d.GetAllocator());
-                arr.PushBack(obj, d.GetAllocator());
-            }
-
-            Value scene;
-            scene.SetObject();
-            scene.AddMember("objects", arr, d.GetAllocator());
-            scene.AddMember("frame", Value(frame.counter), d.GetAllocator());
-            scene.AddMember("detector_nsec", Value(timestamp_2 - timestamp_1), d.GetAllocator());
-
-            Value cmd;
-            cmd.SetObject();
-            cmd.AddMember("CameraObjectDetection", scene, d.GetAllocator());
-            d.AddMember("Command", cmd, d.GetAllocator());
-
-            StringBuffer *buffer = new StringBuffer();
-            Writer<StringBuffer> writer(*buffer);
-            d.Accept(writer);
-            bot->send(buffer);
-        }
+    image_t yolo_img = {};
+    yolo_img.w = frame.width;
+    yolo_img.h = frame.height;
+    yolo_img.c = 3;
+    yolo_img.data = static_cast<float*>(frame.image);
+
+    // Input coordinate system is relative to (squished) image provided to neural net;
+    // output coordinate system should match the overlay rendering, with [0,0] in the
+    // center, aspect correct, and horizontal extents from [-1,+1].
+
+    double x_scale = 2.0 / frame.width;
+    double aspect = frame.source_width ? frame.source_height / (double) frame.source_width : 0.0;
+    double y_scale = x_scale * aspect;
+
+    double center_x = frame.width / 2.0;
+    double center_y = frame.height / 2.0;
+
+    uint64_t timestamp_1 = os_gettime_ns();
+    std::vector<bbox_t> boxes = yolo->detect(yolo_img, 0.1);
+    uint64_t timestamp_2 = os_gettime_ns();
+    inference_latency.record(timestamp_2 - timestamp_1);
+
+    // The local overlay wants results whether or not the controller is there
+    result.frame = frame.counter;
+    result.detector_nsec = timestamp_2 - timestamp_1;
+    result.frame_time = bot->controller_time(frame.timestamp_ns);
+    result.objects.resize(boxes.size());
+
+    for (int n = 0; n < boxes.size(); n++) {
+        bbox_t &box = boxes[n];
+        DetectedObject &obj = result.objects[n];
+
+        obj.rect[0] = x_scale * (box.x - center_x);
+        obj.rect[1] = y_scale * (box.y - center_y);
+        obj.rect[2] = x_scale * box.w;
+        obj.rect[3] = y_scale * box.h;
+        obj.prob = box.prob;
+        obj.class_id = box.obj_id;
+        obj.label = box.obj_id < names.size() ? names[box.obj_id].c_str() : "";
     }
 
-    blog(LOG_INFO, "YOLO detector exiting");
+    overlay->show_detections(result);
+    if (bot->is_authenticated()) {
+        bot->send(result, builder);
+    }
 }
 
 uint32_t DetectorImageFormatter::get_width() {
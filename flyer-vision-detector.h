@@ -1,25 +1,40 @@
 #pragma once
 #include "image-grabber.h"
 #include "bot-connector.h"
-#include <thread>
+#include "overlay-drawing.h"
+#include "task-pool.h"
+#include "latency-histogram.h"
+#include <memory>
 #include <vector>
 #include <string>
-#include <atomic>
 
+class Detector;
+
+// Runs YOLO on the task pool, once per new detector frame
 class FlyerVisionDetector {
 public:
-    FlyerVisionDetector(ImageGrabber *source, BotConnector *bot);
+    FlyerVisionDetector(ImageGrabber *source, BotConnector *bot, OverlayDrawing *overlay);
     ~FlyerVisionDetector();
 
+    // Waits out a run in progress; no more runs happen after this. Safe to repeat.
+    void stop();
+
+    LatencyHistogram::Snapshot get_inference_latency();
+
 private:
-    std::atomic<bool> request_exit;
     ImageGrabber *source;
     BotConnector *bot;
-    std::thread thread;
+    OverlayDrawing *overlay;
+    MessageBuilder builder;
+    ImageGrabber::Frame frame;
+    ObjectDetectionResult result;
+    std::vector<std::string> names;
+    std::unique_ptr<Detector> yolo;     // Loaded by the first run
+    LatencyHistogram inference_latency;
+    SerialTask task;
 
     static std::vector<std::string> load_names(const char* filename);
-    void start();
-    void thread_func();
+    void run();
 };
 
 class DetectorImageFormatter : public ImageFormatter {
@@ -1,47 +1,68 @@
 #include "flyer-vision-tracker.h"
+#include "vision-messages.h"
 #include "util/platform.h"
-#include <rapidjson/document.h>
-#include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
 #include <dlib/image_processing/scan_fhog_pyramid.h>
 #include <dlib/image_processing/correlation_tracker.h>
-#include <dlib/image_saver/save_png.h>
 
-using namespace rapidjson;
 using namespace dlib;
 
-FlyerVisionTracker::FlyerVisionTracker(ImageGrabber *source, BotConnector *bot)
-    : request_exit(false), source(source), bot(bot)
+// Carried from one run to the next
+struct FlyerVisionTracker::TrackState {
+    ImageGrabber::Frame frame;
+    drectangle previous_rect;
+    double previous_psr;
+    unsigned age;
+    bool rect_is_empty;
+    correlation_tracker tracker;
+
+    TrackState()
+        : previous_rect(), previous_psr(0.0), age(0), rect_is_empty(true), tracker(6, 4)
+    {
+        frame.counter = 0;
+    }
+};
+
+FlyerVisionTracker::FlyerVisionTracker(ImageGrabber *source, BotConnector *bot, FrameRecorder *recorder, OverlayDrawing *overlay)
+    : source(source), bot(bot), recorder(recorder), overlay(overlay),
+      state(new TrackState()), task([this] () { run(); })
 {
-    start();
+    source->set_frame_listener(&task);
+    blog(LOG_INFO, "Object tracker running");
 }
 
 FlyerVisionTracker::~FlyerVisionTracker()
 {
-    request_exit.store(true);
-    thread.join();
+    stop();
+    blog(LOG_INFO, "Object tracker exiting");
+}
+
+void FlyerVisionTracker::stop()
+{
+    source->set_frame_listener(NULL);
+    task.stop();
 }
 
-void FlyerVisionTracker::start()
+void FlyerVisionTracker::set_frame_budget_nsec(uint64_t nsec)
 {
-    thread = std::thread([=] () { thread_func(); });
+    scale_scheduler.set_budget_nsec(nsec);
 }
 
-template <typename Allocator>
-static Value drectangle_to_value(ImageGrabber::Frame &frame, drectangle &drect, Allocator &alloc) {
+LatencyHistogram::Snapshot FlyerVisionTracker::get_update_latency()
+{
+    return update_latency.snapshot();
+}
+
+static void drectangle_to_vec4(ImageGrabber::Frame &frame, drectangle &drect, double vec[4]) {
     double x_scale = 2.0 / frame.width;
     double aspect = frame.source_width ? frame.source_height / (double) frame.source_width : 0.0;
     double y_scale = x_scale * aspect;
     double center_x = frame.width / 2.0;
     double center_y = frame.height / 2.0;
 
-    Value arr;
-    arr.SetArray();
-    arr.PushBack(Value((drect.left() - center_x) * x_scale), alloc);
-    arr.PushBack(Value((drect.top() - center_y) * y_scale), alloc);
-    arr.PushBack(Value(drect.width() * x_scale), alloc);
-    arr.PushBack(Value(drect.height() * y_scale), alloc);
-    return arr;
+    vec[0] = (drect.left() - center_x) * x_scale;
+    vec[1] = (drect.top() - center_y) * y_scale;
+    vec[2] = drect.width() * x_scale;
+    vec[3] = drect.height() * y_scale;
 }
 
 static drectangle drectangle_from_vec4(ImageGrabber::Frame &frame, double vec[4]) {
@@ -58,83 +79,77 @@ static drectangle drectangle_from_vec4(ImageGrabber::Frame &frame, double vec[4]
     return rect;
 }
 
-void FlyerVisionTracker::thread_func()
+void FlyerVisionTracker::record_frame(ImageGrabber::Frame &frame, FrameRecorder::Tag tag, const double *rect)
 {
-    ImageGrabber::Frame frame;
-    frame.counter = 0;
-
-    drectangle previous_rect = {};
-    unsigned age = 0;
-    bool rect_is_empty = true;
-    correlation_tracker tracker(6, 4);
-
-    blog(LOG_INFO, "Object tracker thread running");
-    while (!request_exit.load()) {
-        if (!source->wait_for_frame(frame.counter)) {
-            continue;
-        }
-        frame = source->get_latest_frame();
+    if (recorder && recorder->is_enabled()) {
         array2d<rgb_pixel> &array = *static_cast<array2d<rgb_pixel>*>(frame.image);
+        recorder->record(frame, tag, image_data(array), width_step(array) * num_rows(array), rect);
+    }
+}
 
-        if (!rect_is_empty) {
-#if 0
-            char name[200];
-            snprintf(name, sizeof name, "fr-%08u-cont.png", (unsigned)frame.counter);
-            save_png(array, name);
-#endif
-
-            age++;
-            uint64_t timestamp_1 = os_gettime_ns();
-            double psr = tracker.update_noscale(array);
-            uint64_t timestamp_2 = os_gettime_ns();
-            drectangle rect = tracker.get_position();
-
-            // The tracker can fail and give us NaN sometimes, which makes JSON serialize fail
-            if (!(psr >= 0.0)) psr = 0.0;
-
-            Document d;
-            d.SetObject();
-
-            Value obj;
-            obj.SetObject();
-            obj.AddMember("rect", drectangle_to_value(frame, rect, d.GetAllocator()), d.GetAllocator());
-            obj.AddMember("previous_rect", drectangle_to_value(frame, previous_rect, d.GetAllocator()), d.GetAllocator());
-            obj.AddMember("frame", frame.counter, d.GetAllocator());
-            obj.AddMember("age", age, d.GetAllocator());
-            obj.AddMember("psr", psr, d.GetAllocator());
-            obj.AddMember("tracker_nsec", Value(timestamp_2 - timestamp_1), d.GetAllocator());
-
-            Value cmd;
-            cmd.SetObject();
-            cmd.AddMember("CameraRegionTracking", obj, d.GetAllocator());
-            d.AddMember("Command", cmd, d.GetAllocator());
-
-            StringBuffer *buffer = new StringBuffer();
-            Writer<StringBuffer> writer(*buffer);
-            d.Accept(writer);
-            bot->send(buffer);
+void FlyerVisionTracker::run()
+{
+    ImageGrabber::Frame &frame = state->frame;
+    drectangle &previous_rect = state->previous_rect;
+    double &previous_psr = state->previous_psr;
+    unsigned &age = state->age;
+    bool &rect_is_empty = state->rect_is_empty;
+    correlation_tracker &tracker = state->tracker;
+
+    if (!source->get_frame_after(frame.counter, frame)) {
+        return;
+    }
 
-            previous_rect = rect;
-        }
+    features.set_frame(frame);
+
+    if (!rect_is_empty) {
+        record_frame(frame, FrameRecorder::TAG_CONTINUE);
+
+        age++;
+        bool scaled = scale_scheduler.should_scale(previous_psr);
+        uint64_t timestamp_1 = os_gettime_ns();
+        double psr = scaled ? tracker.update(features.gray()) : tracker.update_noscale(features.gray());
+        uint64_t timestamp_2 = os_gettime_ns();
+        scale_scheduler.record_update(scaled, timestamp_2 - timestamp_1);
+        update_latency.record(timestamp_2 - timestamp_1);
+        drectangle rect = tracker.get_position();
+
+        // The tracker can fail and give us NaN sometimes, which makes JSON serialize fail
+        if (!(psr >= 0.0)) psr = 0.0;
+
+        RegionTrackingResult result;
+        drectangle_to_vec4(frame, rect, result.rect);
+        drectangle_to_vec4(frame, previous_rect, result.previous_rect);
+        result.frame = frame.counter;
+        result.age = age;
+        result.psr = psr;
+        result.tracker_nsec = timestamp_2 - timestamp_1;
+        result.scaled = scaled;
+        result.scale_updates = scale_scheduler.get_scale_count();
+        result.noscale_updates = scale_scheduler.get_noscale_count();
+        result.frame_time = bot->controller_time(frame.timestamp_ns);
+        overlay->show_tracked_region(result.rect);
+        bot->send(result, builder);
+
+        previous_rect = rect;
+        previous_psr = psr;
+    }
 
-        double init_rect[4];
-        if (bot->poll_for_tracking_region_reset(init_rect)) {
-            rect_is_empty = init_rect[2] <= 0.0 || init_rect[3] <= 0.0;
-            if (!rect_is_empty) {
-#if 0
-                char name[200];
-                snprintf(name, sizeof name, "fr-%08u-init.png", (unsigned)frame.counter);
-                save_png(array, name);
-#endif
-                drectangle rect = drectangle_from_vec4(frame, init_rect);
-                tracker.start_track(array, rect);
-                age = 0;
-                previous_rect = rect;
-            }
+    double init_rect[4];
+    if (bot->poll_for_tracking_region_reset(init_rect)) {
+        rect_is_empty = init_rect[2] <= 0.0 || init_rect[3] <= 0.0;
+        if (rect_is_empty) {
+            overlay->hide_tracked_region();
+        } else {
+            drectangle rect = drectangle_from_vec4(frame, init_rect);
+            double corners[4] = { rect.left(), rect.top(), rect.right(), rect.bottom() };
+            record_frame(frame, FrameRecorder::TAG_INIT, corners);
+            tracker.start_track(features.gray(), rect);
+            age = 0;
+            previous_rect = rect;
+            previous_psr = 0.0;
         }
     }
-
-    blog(LOG_INFO, "Object tracker thread exiting");
 }
 
 uint32_t TrackerImageFormatter::get_width() {
@@ -1,24 +1,44 @@
 #pragma once
 #include "image-grabber.h"
 #include "bot-connector.h"
-#include <thread>
+#include "frame-recorder.h"
+#include "overlay-drawing.h"
+#include "tracker-feature-cache.h"
+#include "tracker-scale-scheduler.h"
+#include "task-pool.h"
+#include "latency-histogram.h"
+#include <memory>
 #include <vector>
 #include <string>
-#include <atomic>
 
+// Updates the correlation tracker on the task pool, once per new tracker frame
 class FlyerVisionTracker {
 public:
-    FlyerVisionTracker(ImageGrabber *source, BotConnector *bot);
+    FlyerVisionTracker(ImageGrabber *source, BotConnector *bot, FrameRecorder *recorder, OverlayDrawing *overlay);
     ~FlyerVisionTracker();
 
+    // Waits out a run in progress; no more runs happen after this. Safe to repeat.
+    void stop();
+
+    void set_frame_budget_nsec(uint64_t nsec);
+    LatencyHistogram::Snapshot get_update_latency();
+
 private:
-    std::atomic<bool> request_exit;
+    struct TrackState;
+
     ImageGrabber *source;
     BotConnector *bot;
-    std::thread thread;
+    FrameRecorder *recorder;
+    OverlayDrawing *overlay;
+    TrackerFeatureCache features;
+    TrackerScaleScheduler scale_scheduler;
+    MessageBuilder builder;
+    LatencyHistogram update_latency;
+    std::unique_ptr<TrackState> state;
+    SerialTask task;
 
-    void start();
-    void thread_func();
+    void record_frame(ImageGrabber::Frame &frame, FrameRecorder::Tag tag, const double *rect = 0);
+    void run();
 };
 
 class TrackerImageFormatter : public ImageFormatter {
@@ -0,0 +1,172 @@
+#include "frame-recorder.h"
+#include "util/platform.h"
+#include <time.h>
+#include <string.h>
+
+#define LOG_PREFIX      "FrameRecorder: "
+
+using namespace std::chrono_literals;
+
+FrameRecorder::FrameRecorder(uint32_t num_slots, uint32_t slot_size)
+    : request_exit(false),
+      enabled(false),
+      recorded_count(0),
+      dropped_count(0),
+      num_slots(num_slots),
+      slot_size(slot_size),
+      slots(new Slot[num_slots]),
+      head(0),
+      tail(0),
+      file(0)
+{
+    for (uint32_t i = 0; i < num_slots; i++) {
+        slots[i].data.resize(slot_size);
+    }
+    thread = std::thread([=] () { thread_func(); });
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    request_exit.store(true);
+    wake_cond.notify_one();
+    thread.join();
+    close_file();
+    delete[] slots;
+}
+
+void FrameRecorder::set_directory(const char *path)
+{
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    directory = path;
+}
+
+void FrameRecorder::set_enabled(bool enabled)
+{
+    this->enabled.store(enabled);
+    wake_cond.notify_one();
+}
+
+bool FrameRecorder::is_enabled()
+{
+    return enabled.load();
+}
+
+uint64_t FrameRecorder::get_recorded_count()
+{
+    return recorded_count.load();
+}
+
+uint64_t FrameRecorder::get_dropped_count()
+{
+    return dropped_count.load();
+}
+
+bool FrameRecorder::record(ImageGrabber::Frame const &frame, Tag tag, const void *pixels, uint32_t size,
+    const double *rect)
+{
+    if (!enabled.load()) {
+        return false;
+    }
+
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (size > slot_size || h - tail.load(std::memory_order_acquire) >= num_slots) {
+        dropped_count++;
+        return false;
+    }
+
+    Slot &slot = slots[h % num_slots];
+    RecordHeader &rh = slot.header;
+    memcpy(rh.magic, "FRAM", sizeof rh.magic);
+    rh.tag = tag;
+    rh.counter = frame.counter;
+    rh.width = frame.width;
+    rh.height = frame.height;
+    rh.source_width = frame.source_width;
+    rh.source_height = frame.source_height;
+    rh.size = size;
+    rh.timestamp_ns = frame.timestamp_ns;
+    for (int i = 0; i < 4; i++) {
+        rh.rect[i] = rect ? rect[i] : 0.0;
+    }
+    memcpy(slot.data.data(), pixels, size);
+
+    head.store(h + 1, std::memory_order_release);
+    wake_cond.notify_one();
+    return true;
+}
+
+void FrameRecorder::open_file()
+{
+    char name[64];
+    time_t now = time(0);
+    strftime(name, sizeof name, "tracker-%Y%m%d-%H%M%S.tfr", localtime(&now));
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(directory_mutex);
+        path = directory;
+    }
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+        path += '/';
+    }
+    path += name;
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        blog(LOG_ERROR, LOG_PREFIX "Can't open %s for writing, recording disabled", path.c_str());
+        enabled.store(false);
+        return;
+    }
+
+    FileHeader fh;
+    memcpy(fh.magic, "TFRC", sizeof fh.magic);
+    fh.version = 2;
+    fwrite(&fh, sizeof fh, 1, file);
+    blog(LOG_INFO, LOG_PREFIX "Recording frames to %s", path.c_str());
+}
+
+void FrameRecorder::close_file()
+{
+    if (file) {
+        fclose(file);
+        file = 0;
+        blog(LOG_INFO, LOG_PREFIX "Recording stopped, %llu frames written, %llu dropped",
+            (unsigned long long) recorded_count.load(),
+            (unsigned long long) dropped_count.load());
+    }
+}
+
+void FrameRecorder::thread_func()
+{
+    while (!request_exit.load()) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cond.wait_for(lock, 100ms, [=] {
+                return request_exit.load() || head.load() != tail.load() || (file && !enabled.load());
+            });
+        }
+
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        while (t != head.load(std::memory_order_acquire)) {
+            Slot &slot = slots[t % num_slots];
+
+            if (!file && enabled.load()) {
+                open_file();
+            }
+            if (file) {
+                fwrite(&slot.header, sizeof slot.header, 1, file);
+                fwrite(slot.data.data(), 1, slot.header.size, file);
+                recorded_count++;
+            } else {
+                dropped_count++;
+            }
+
+            t++;
+            tail.store(t, std::memory_order_release);
+        }
+
+        if (file && !enabled.load()) {
+            close_file();
+        }
+    }
+}
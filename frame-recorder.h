@@ -0,0 +1,87 @@
+#pragma once
+#include "image-grabber.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Records grabber frames to disk without stalling the thread that produces them.
+// The producer copies each frame into a fixed ring of preallocated slots and never
+// waits; a background thread appends the slots to a raw container file. If the disk
+// falls behind and the ring is full, frames are dropped and counted.
+//
+// Container layout, little-endian: a FileHeader, then one RecordHeader plus
+// 'size' bytes of pixel data per frame.
+
+class FrameRecorder {
+public:
+    FrameRecorder(uint32_t num_slots = 32, uint32_t slot_size = 256 * 256 * 3);
+    ~FrameRecorder();
+
+    enum Tag {
+        TAG_INIT = 'I',         // Frame used to (re)initialize a tracker
+        TAG_CONTINUE = 'C',     // Frame used to update a running tracker
+    };
+
+    void set_directory(const char *path);
+    void set_enabled(bool enabled);
+    bool is_enabled();
+
+    // Single producer only. Returns false if the frame was dropped. TAG_INIT frames
+    // also carry the rect the tracker starts from, as left, top, right, bottom pixels.
+    bool record(ImageGrabber::Frame const &frame, Tag tag, const void *pixels, uint32_t size,
+        const double *rect = 0);
+
+    uint64_t get_recorded_count();
+    uint64_t get_dropped_count();
+
+    struct FileHeader {
+        char magic[4];          // "TFRC"
+        uint32_t version;       // 2 added RecordHeader::rect
+    };
+
+    struct RecordHeader {
+        char magic[4];          // "FRAM"
+        uint32_t tag;
+        uint32_t counter;
+        uint32_t width, height;
+        uint32_t source_width, source_height;
+        uint32_t size;
+        uint64_t timestamp_ns;
+        double rect[4];         // Zero unless tag is TAG_INIT
+    };
+
+private:
+    struct Slot {
+        RecordHeader header;
+        std::vector<uint8_t> data;
+    };
+
+    std::atomic<bool> request_exit;
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> recorded_count;
+    std::atomic<uint64_t> dropped_count;
+
+    uint32_t num_slots;
+    uint32_t slot_size;
+    Slot *slots;
+    std::atomic<uint32_t> head;     // Next slot to fill, written by the producer
+    std::atomic<uint32_t> tail;     // Next slot to write, written by the writer thread
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_cond;
+
+    std::mutex directory_mutex;
+    std::string directory;
+
+    FILE *file;
+    std::thread thread;
+
+    void thread_func();
+    void open_file();
+    void close_file();
+};
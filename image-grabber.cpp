@@ -1,8 +1,8 @@
 #include "image-grabber.h"
+#include "util/platform.h"
+#include <string.h>
 #include <dlib/image_processing.h>
 
-using namespace std::chrono_literals;
-
 ImageGrabber::ImageGrabber(ImageFormatter &fmt, uint32_t frames)
     : fmt(fmt),
       num_frames(frames),
@@ -10,6 +10,12 @@ ImageGrabber::ImageGrabber(ImageFormatter &fmt, uint32_t frames)
       frame_fifo(new Frame[num_frames]),
       tick_flag(false),
       readback_flag(false),
+      frame_listener(0),
+      readback_linesize(0),
+      converting(false),
+      readback_nsec(0),
+      latest_ready_nsec(0),
+      convert_task([this] () { convert_readback(); }),
       texrender_4x(0),
       texrender_final(0),
       stagesurface(0)
@@ -17,6 +23,7 @@ ImageGrabber::ImageGrabber(ImageFormatter &fmt, uint32_t frames)
     for (uint32_t i = 0; i < num_frames; i++) {
         frame_fifo[i].source_width = 0;
         frame_fifo[i].source_height = 0;
+        frame_fifo[i].timestamp_ns = 0;
         frame_fifo[i].width = fmt.get_width();
         frame_fifo[i].height = fmt.get_height();
         frame_fifo[i].image = fmt.new_image();
@@ -33,6 +40,8 @@ ImageGrabber::ImageGrabber(ImageFormatter &fmt, uint32_t frames)
 
 ImageGrabber::~ImageGrabber()
 {
+    convert_task.stop();
+
     obs_enter_graphics();
 
     for (uint32_t i = 0; i < num_frames; i++) {
@@ -55,13 +64,16 @@ ImageGrabber::~ImageGrabber()
 
 void ImageGrabber::tick()
 {
+    if (tick_flag) {
+        stats.skipped++;
+    }
     tick_flag = true;
 }
 
 void ImageGrabber::render(obs_source_t *source)
 {
-    // At most once per tick
-    if (tick_flag == false) {
+    // At most once per tick, and not while the last frame is still being converted
+    if (tick_flag == false || converting.load()) {
         return;
     }
     tick_flag = false;
@@ -81,10 +93,12 @@ void ImageGrabber::render(obs_source_t *source)
     if (!target_width || !target_height) {
         return;
     }
+    uint64_t render_start = os_gettime_ns();
 
     // Save our source's size, for coordinate transformation after running computer vision
     frame->source_width = obs_source_get_base_width(source);
     frame->source_height = obs_source_get_base_height(source);
+    frame->timestamp_ns = os_gettime_ns();
 
     // Resource allocation
     if (texrender_final) {
@@ -136,6 +150,7 @@ void ImageGrabber::render(obs_source_t *source)
     // Must copy texture into a staging buffer to read it back later
     gs_stage_texture(stagesurface, gs_texrender_get_texture(texrender_final));
     readback_flag = true;
+    latency[STAGE_RENDER].record(os_gettime_ns() - render_start);
 }
 
 void ImageGrabber::post_render()
@@ -145,29 +160,58 @@ void ImageGrabber::post_render()
     if (readback_flag && stagesurface) {
         readback_flag = false;
 
-        Frame *frame = next_writable_frame();
         uint8_t *ptr = 0;
         uint32_t linesize = 0;
+        uint64_t map_start = os_gettime_ns();
 
         if (gs_stagesurface_map(stagesurface, &ptr, &linesize)) {
-            fmt.rgba_to_image(frame->image, ptr, linesize);
+            // Only the copy happens here; the format conversion is left to the pool
+            size_t size = (size_t) linesize * fmt.get_height();
+            readback.resize(size);
+            memcpy(readback.data(), ptr, size);
+            readback_linesize = linesize;
             gs_stagesurface_unmap(stagesurface);
-        }
 
-        finish_writing_frame(frame);
+            readback_nsec = os_gettime_ns();
+            latency[STAGE_READBACK].record(readback_nsec - map_start);
+            converting.store(true);
+            convert_task.trigger();
+        } else {
+            finish_writing_frame(next_writable_frame());
+        }
     }
 }
 
-bool ImageGrabber::wait_for_frame(unsigned prev_counter)
+void ImageGrabber::convert_readback()
+{
+    uint64_t convert_start = os_gettime_ns();
+    latency[STAGE_CONVERT_WAIT].record(convert_start - readback_nsec);
+
+    Frame *frame = next_writable_frame();
+    fmt.rgba_to_image(frame->image, readback.data(), readback_linesize);
+    latency[STAGE_CONVERT].record(os_gettime_ns() - convert_start);
+    finish_writing_frame(frame);
+    converting.store(false);
+}
+
+bool ImageGrabber::get_frame_after(unsigned prev_counter, Frame &frame)
 {
     std::unique_lock<std::mutex> lock(latest_counter_mutex);
-    return latest_counter_cond.wait_for(lock, 40ms, [=] { return latest_counter != prev_counter; });
+    if (latest_counter == prev_counter) {
+        return false;
+    }
+    frame = frame_fifo[latest_counter % num_frames];
+
+    stats.consumed++;
+    stats.dropped += latest_counter - prev_counter - 1;
+    latency[STAGE_CONSUME_WAIT].record(os_gettime_ns() - latest_ready_nsec);
+    return true;
 }
 
-ImageGrabber::Frame ImageGrabber::get_latest_frame()
+void ImageGrabber::set_frame_listener(SerialTask *listener)
 {
     std::unique_lock<std::mutex> lock(latest_counter_mutex);
-    return frame_fifo[latest_counter % num_frames];
+    frame_listener = listener;
 }
 
 ImageGrabber::Frame *ImageGrabber::next_writable_frame()
@@ -182,6 +226,24 @@ void ImageGrabber::finish_writing_frame(Frame *frame)
 {
     std::unique_lock<std::mutex> lock(latest_counter_mutex);
     latest_counter = frame->counter;
-    lock.unlock();
-    latest_counter_cond.notify_all();
+    latest_ready_nsec = os_gettime_ns();
+    stats.captured++;
+    if (frame_listener) {
+        frame_listener->trigger();
+    }
+}
+
+ImageGrabber::Stats ImageGrabber::get_stats()
+{
+    Stats s;
+    s.captured = stats.captured.load();
+    s.consumed = stats.consumed.load();
+    s.skipped = stats.skipped.load();
+    s.dropped = stats.dropped.load();
+    return s;
+}
+
+LatencyHistogram::Snapshot ImageGrabber::get_latency(Stage stage)
+{
+    return latency[stage].snapshot();
 }
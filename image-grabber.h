@@ -1,8 +1,11 @@
 #pragma once
 #include <obs-module.h>
 #include <stdint.h>
+#include <atomic>
 #include <mutex>
-#include <condition_variable>
+#include <vector>
+#include "task-pool.h"
+#include "latency-histogram.h"
 
 class ImageFormatter {
 public:
@@ -26,21 +29,62 @@ public:
         uint32_t width, height;
         uint32_t source_width, source_height;
         unsigned counter;
+        uint64_t timestamp_ns;
         void *image;
     };
 
-    bool wait_for_frame(unsigned prev_counter);
-    Frame get_latest_frame();
+    // Copies out the latest frame if it's newer than prev_counter; doesn't wait
+    bool get_frame_after(unsigned prev_counter, Frame &frame);
+
+    // Triggered each time a new frame is ready. NULL to stop; once this returns
+    // the previous listener won't be triggered again.
+    void set_frame_listener(SerialTask *listener);
+
+    enum Stage {
+        STAGE_RENDER,           // Drawing the source into the capture textures
+        STAGE_READBACK,         // Mapping and copying out the staged surface
+        STAGE_CONVERT_WAIT,     // Copied readback waiting for a pool worker
+        STAGE_CONVERT,
+        STAGE_CONSUME_WAIT,     // Finished frame waiting for get_frame_after()
+        num_stages,
+    };
+
+    struct Stats {
+        uint64_t captured;
+        uint64_t consumed;
+        uint64_t skipped;       // Ticks that passed without a capture, e.g. while converting
+        uint64_t dropped;       // Captured frames replaced before they were consumed
+    };
+
+    Stats get_stats();
+    LatencyHistogram::Snapshot get_latency(Stage stage);
 
 private:
     ImageFormatter &fmt;
     std::mutex latest_counter_mutex;
-    std::condition_variable latest_counter_cond;
     uint32_t latest_counter;
     uint32_t num_frames;
     Frame *frame_fifo;
     bool tick_flag;
     bool readback_flag;
+    SerialTask *frame_listener;
+
+    // Readback is copied out on the render thread and converted on the task pool.
+    // No new frame is rendered until the conversion finishes with its slot.
+    std::vector<uint8_t> readback;
+    uint32_t readback_linesize;
+    std::atomic<bool> converting;
+    uint64_t readback_nsec;
+    uint64_t latest_ready_nsec;
+    SerialTask convert_task;
+
+    struct {
+        std::atomic<uint64_t> captured{0};
+        std::atomic<uint64_t> consumed{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> dropped{0};
+    } stats;
+    LatencyHistogram latency[num_stages];
 
     gs_texrender_t *texrender_4x;
     gs_texrender_t *texrender_final;
@@ -52,4 +96,5 @@ private:
 
     Frame *next_writable_frame();
     void finish_writing_frame(Frame *frame);
+    void convert_readback();
 };
@@ -0,0 +1,122 @@
+#include "latency-histogram.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned highest_bit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    for (unsigned i = 0; i < num_buckets; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0);
+    sum.store(0);
+    max.store(0);
+}
+
+unsigned LatencyHistogram::bucket_index(uint64_t value)
+{
+    const uint64_t sub_count = 1 << sub_bits;
+    if (value < sub_count) {
+        return (unsigned) value;
+    }
+    unsigned msb = highest_bit(value);
+    unsigned shift = msb - sub_bits;
+    return ((shift + 1) << sub_bits) + (unsigned)((value >> shift) & (sub_count - 1));
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(unsigned index)
+{
+    const uint64_t sub_count = 1 << sub_bits;
+    if (index < sub_count) {
+        return index;
+    }
+    unsigned shift = (index >> sub_bits) - 1;
+    return (sub_count + (index & (sub_count - 1))) << shift;
+}
+
+void LatencyHistogram::record(uint64_t nsec)
+{
+    counts[bucket_index(nsec)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nsec, std::memory_order_relaxed);
+
+    uint64_t prev = max.load(std::memory_order_relaxed);
+    while (nsec > prev && !max.compare_exchange_weak(prev, nsec, std::memory_order_relaxed));
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot s;
+    s.counts.resize(num_buckets);
+    for (unsigned i = 0; i < num_buckets; i++) {
+        s.counts[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    s.count = count.load();
+    s.sum = sum.load();
+    s.max = max.load();
+    return s;
+}
+
+double LatencyHistogram::Snapshot::mean() const
+{
+    return count ? sum / (double) count : 0.0;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::since(Snapshot const &earlier) const
+{
+    Snapshot s;
+    s.counts.resize(counts.size());
+    s.count = 0;
+    s.sum = sum - earlier.sum;
+    s.max = 0;
+
+    for (unsigned i = 0; i < counts.size(); i++) {
+        uint64_t prev = i < earlier.counts.size() ? earlier.counts[i] : 0;
+        s.counts[i] = counts[i] - prev;
+        s.count += s.counts[i];
+        if (s.counts[i]) {
+            uint64_t upper = i + 1 < counts.size() ? bucket_lower_bound(i + 1) - 1 : max;
+            s.max = upper < max ? upper : max;
+        }
+    }
+    return s;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double fraction) const
+{
+    uint64_t total = 0;
+    for (uint64_t c : counts) {
+        total += c;
+    }
+    if (!total) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(fraction * total);
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen > target) {
+            uint64_t lower = bucket_lower_bound(i);
+            uint64_t upper = i + 1 < counts.size() ? bucket_lower_bound(i + 1) : lower;
+            return lower + (upper - lower) / 2;
+        }
+    }
+    return max;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Lock-free histogram of durations in nanoseconds. Buckets are log-linear: each
+// power of two is split into 8 linear steps, so any recorded value is known to
+// within 12.5% across the whole 64-bit range. record() can be called from any
+// number of threads; snapshot() gives a consistent-enough copy for reporting.
+
+class LatencyHistogram {
+public:
+    static const unsigned sub_bits = 3;
+    static const unsigned num_buckets = (64 - sub_bits + 1) << sub_bits;
+
+    LatencyHistogram();
+
+    void record(uint64_t nsec);
+    void reset();
+
+    struct Snapshot {
+        std::vector<uint64_t> counts;
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+
+        double mean() const;
+        // Bucket midpoint below which 'fraction' of samples fall, 0 if empty
+        uint64_t percentile(double fraction) const;
+
+        // Samples recorded after 'earlier', a snapshot of the same histogram. The max
+        // is the top of the highest bucket used, no more than the overall max.
+        Snapshot since(Snapshot const &earlier) const;
+    };
+    Snapshot snapshot() const;
+
+    static unsigned bucket_index(uint64_t value);
+    static uint64_t bucket_lower_bound(unsigned index);
+
+private:
+    std::atomic<uint64_t> counts[num_buckets];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
@@ -0,0 +1,86 @@
+#include "message-pool.h"
+
+using namespace rapidjson;
+
+std::atomic<uint64_t> CountingAllocator::count(0);
+
+void release_message(MessageBuffer *buffer)
+{
+    if (buffer->pool) {
+        buffer->pool->release(buffer);
+    } else {
+        delete buffer;
+    }
+}
+
+MessagePool::MessagePool(unsigned max_free)
+    : max_free(max_free)
+{
+    free_list.reserve(max_free);
+}
+
+MessagePool::~MessagePool()
+{
+    for (MessageBuffer *buffer : free_list) {
+        delete buffer;
+    }
+}
+
+MessageBuffer *MessagePool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_list.empty()) {
+            MessageBuffer *buffer = free_list.back();
+            free_list.pop_back();
+            return buffer;
+        }
+    }
+    CountingAllocator::count_allocation();
+    return new MessageBuffer(this);
+}
+
+void MessagePool::release(MessageBuffer *buffer)
+{
+    buffer->Clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_list.size() < max_free) {
+        free_list.push_back(buffer);
+    } else {
+        delete buffer;
+    }
+}
+
+MessageBuilder::MessageBuilder()
+    : allocator(arena, arena_size),
+      document(&allocator)
+{}
+
+MessageDocument &MessageBuilder::begin()
+{
+    // Drop all references into the arena before rewinding it
+    document.SetNull();
+    allocator.Clear();
+    document.SetObject();
+    return document;
+}
+
+MessageBuffer *MessageBuilder::finish()
+{
+    MessageBuffer *buffer = pool.acquire();
+    writer.Reset(*buffer);
+    document.Accept(writer);
+    return buffer;
+}
+
+MessageBuffer *MessageBuilder::acquire()
+{
+    return pool.acquire();
+}
+
+MessageWriter &MessageBuilder::writer_for(MessageBuffer &buffer)
+{
+    writer.Reset(buffer);
+    return writer;
+}
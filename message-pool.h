@@ -0,0 +1,121 @@
+#pragma once
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Heap allocator for everything we allocate while building messages. It behaves
+// like rapidjson's CrtAllocator but counts each allocation or growing reallocation,
+// so serialization can be shown to allocate nothing in the steady state. The send
+// itself still allocates: websocketpp copies every payload into a message of its
+// own, and masks it into another, as a client must.
+
+class CountingAllocator {
+public:
+    static const bool kNeedFree = true;
+
+    void* Malloc(size_t size) {
+        if (!size) {
+            return NULL;
+        }
+        count_allocation();
+        return malloc(size);
+    }
+
+    void* Realloc(void* original_ptr, size_t original_size, size_t new_size) {
+        if (!new_size) {
+            free(original_ptr);
+            return NULL;
+        }
+        if (new_size > original_size) {
+            count_allocation();
+        }
+        return realloc(original_ptr, new_size);
+    }
+
+    static void Free(void *ptr) {
+        free(ptr);
+    }
+
+    bool operator==(const CountingAllocator&) const { return true; }
+    bool operator!=(const CountingAllocator&) const { return false; }
+
+    static void count_allocation() {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static uint64_t get_count() {
+        return count.load();
+    }
+
+private:
+    static std::atomic<uint64_t> count;
+};
+
+typedef rapidjson::GenericStringBuffer<rapidjson::UTF8<>, CountingAllocator> MessageStringBuffer;
+typedef rapidjson::Writer<MessageStringBuffer, rapidjson::UTF8<>, rapidjson::UTF8<>, CountingAllocator> MessageWriter;
+typedef rapidjson::MemoryPoolAllocator<CountingAllocator> MessageAllocator;
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>, MessageAllocator, CountingAllocator> MessageDocument;
+typedef MessageDocument::ValueType MessageValue;
+
+class MessagePool;
+
+// A serialized message. Whoever consumes it calls release_message(), which
+// returns it to the pool it came from, or deletes it if it has none. Sending
+// copies the payload, so that can happen as soon as send() returns.
+class MessageBuffer : public MessageStringBuffer {
+public:
+    MessageBuffer(MessagePool *pool = 0) : pool(pool) {}
+    MessagePool *pool;
+};
+
+void release_message(MessageBuffer *buffer);
+
+// Recycles message buffers for one producing thread. Buffers keep their capacity
+// while pooled; release() may be called from any thread. The pool must outlive
+// every buffer it hands out.
+class MessagePool {
+public:
+    MessagePool(unsigned max_free = 16);
+    ~MessagePool();
+
+    MessageBuffer *acquire();
+    void release(MessageBuffer *buffer);
+
+private:
+    std::mutex mutex;
+    std::vector<MessageBuffer*> free_list;
+    unsigned max_free;
+};
+
+// Per-thread message building state: a buffer pool, a Document whose allocator
+// starts from a fixed arena and is rewound for each message, and a Writer whose
+// stack is kept between messages.
+class MessageBuilder {
+public:
+    MessageBuilder();
+
+    // Rewinds the arena and returns the document as an empty object.
+    MessageDocument &begin();
+
+    // Serializes the document from begin() into a pooled buffer.
+    MessageBuffer *finish();
+
+    // For encoders that write straight into a buffer, without the document:
+    // a pooled buffer, and the writer reset to write into it.
+    MessageBuffer *acquire();
+    MessageWriter &writer_for(MessageBuffer &buffer);
+
+private:
+    static constexpr size_t arena_size = 16 * 1024;
+    char arena[arena_size];
+
+    MessagePool pool;
+    MessageAllocator allocator;
+    MessageDocument document;
+    MessageWriter writer;
+};
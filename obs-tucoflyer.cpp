@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include "flyer-camera-filter.h"
+#include "task-pool.h"
 
 OBS_DECLARE_MODULE()
 
@@ -10,3 +11,9 @@ bool obs_module_load(void)
     FlyerCameraFilter::module_load();
     return true;
 }
+
+void obs_module_unload(void)
+{
+    // Join the vision workers before the module's code goes away
+    TaskPool::get().shutdown();
+}
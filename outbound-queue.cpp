@@ -0,0 +1,201 @@
+#include "outbound-queue.h"
+#include <string.h>
+#include <chrono>
+
+// Starvation protection for the bulk lane
+#define MAX_CONTROL_RUN             8
+#define MAX_BULK_WAIT_NSEC          50000000
+
+static uint64_t now_nsec()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OutboundQueue::OutboundQueue(size_t max_messages, size_t max_bytes)
+    : max_messages(max_messages),
+      max_bytes(max_bytes),
+      count(0),
+      bytes(0),
+      control_run(0)
+{
+    memset(&stats, 0, sizeof stats);
+}
+
+OutboundQueue::~OutboundQueue()
+{
+    for (auto &lane : lanes) {
+        for (Message &msg : lane) {
+            release_message(msg.buffer);
+        }
+    }
+}
+
+bool OutboundQueue::is_coalesced(MessageKind kind)
+{
+    switch (kind) {
+    case MessageKind::CameraRegionTracking:
+    case MessageKind::CameraObjectDetection:
+    case MessageKind::CameraOutputStatus:
+    case MessageKind::CameraPipelineStats:
+        return true;
+    default:
+        return false;
+    }
+}
+
+MessageLane OutboundQueue::lane_for(MessageKind kind)
+{
+    return kind == MessageKind::CameraRegionTracking ? MessageLane::Control : MessageLane::Bulk;
+}
+
+const char *OutboundQueue::kind_name(MessageKind kind)
+{
+    switch (kind) {
+    case MessageKind::CameraRegionTracking:     return "CameraRegionTracking";
+    case MessageKind::CameraObjectDetection:    return "CameraObjectDetection";
+    case MessageKind::CameraOutputStatus:       return "CameraOutputStatus";
+    case MessageKind::CameraPipelineStats:      return "CameraPipelineStats";
+    default:                                    return "Generic";
+    }
+}
+
+bool OutboundQueue::push(MessageKind kind, MessageBuffer *buffer, bool binary)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::deque<Message> &fifo = lanes[(unsigned) lane_for(kind)];
+    stats.queued++;
+
+    if (is_coalesced(kind)) {
+        for (Message &msg : fifo) {
+            if (msg.kind == kind) {
+                // Keeps the original queued time; latency is measured for the queue position
+                bytes -= msg.buffer->GetSize();
+                bytes += buffer->GetSize();
+                release_message(msg.buffer);
+                msg.buffer = buffer;
+                msg.binary = binary;
+                stats.replaced++;
+                return false;
+            }
+        }
+    }
+
+    bool was_empty = !count;
+    Message msg = { kind, binary, buffer, now_nsec() };
+    fifo.push_back(msg);
+    count++;
+    bytes += buffer->GetSize();
+
+    while (count > 1 && (count > max_messages || bytes > max_bytes)) {
+        drop_oldest();
+    }
+
+    return was_empty;
+}
+
+void OutboundQueue::drop_oldest()
+{
+    for (unsigned i = num_lanes; i-- > 0;) {
+        if (!lanes[i].empty()) {
+            bytes -= lanes[i].front().buffer->GetSize();
+            release_message(lanes[i].front().buffer);
+            lanes[i].pop_front();
+            count--;
+            stats.dropped++;
+            return;
+        }
+    }
+}
+
+bool OutboundQueue::pop(Message &msg, bool allow_bulk)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::deque<Message> &control = lanes[(unsigned) MessageLane::Control];
+    std::deque<Message> &bulk = lanes[(unsigned) MessageLane::Bulk];
+    uint64_t now = now_nsec();
+
+    bool take_bulk;
+    if (control.empty()) {
+        take_bulk = allow_bulk && !bulk.empty();
+    } else {
+        take_bulk = allow_bulk && !bulk.empty() &&
+            (control_run >= MAX_CONTROL_RUN || now - bulk.front().queued_nsec >= MAX_BULK_WAIT_NSEC);
+        if (take_bulk) {
+            stats.bulk_promoted++;
+        }
+    }
+
+    MessageLane lane;
+    if (take_bulk) {
+        lane = MessageLane::Bulk;
+        control_run = 0;
+    } else if (!control.empty()) {
+        lane = MessageLane::Control;
+        control_run++;
+    } else {
+        return false;
+    }
+
+    std::deque<Message> &fifo = lanes[(unsigned) lane];
+    msg = fifo.front();
+    fifo.pop_front();
+    count--;
+    bytes -= msg.buffer->GetSize();
+    stats.sent++;
+    stats.sent_by_lane[(unsigned) lane]++;
+    stats.sent_by_kind[(unsigned) msg.kind]++;
+    stats.bytes_by_kind[(unsigned) msg.kind] += msg.buffer->GetSize();
+    latency[(unsigned) lane].record(now - msg.queued_nsec);
+    return true;
+}
+
+void OutboundQueue::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &lane : lanes) {
+        for (Message &msg : lane) {
+            release_message(msg.buffer);
+            stats.dropped++;
+        }
+        lane.clear();
+    }
+    count = 0;
+    bytes = 0;
+    control_run = 0;
+}
+
+void OutboundQueue::count_dropped()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.dropped++;
+}
+
+void OutboundQueue::count_frame()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.frames++;
+}
+
+size_t OutboundQueue::get_pending_bytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+size_t OutboundQueue::get_pending_count()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+OutboundQueue::Stats OutboundQueue::get_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+LatencyHistogram::Snapshot OutboundQueue::get_latency(MessageLane lane)
+{
+    return latency[(unsigned) lane].snapshot();
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "message-pool.h"
+#include "latency-histogram.h"
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+
+enum class MessageKind {
+    Generic,
+    CameraRegionTracking,
+    CameraObjectDetection,
+    CameraOutputStatus,
+    CameraPipelineStats,
+};
+
+// Traffic classes, highest priority first
+enum class MessageLane {
+    Control,        // Steers the gimbal; always written first
+    Bulk,           // Detections, status and everything else
+};
+
+// Bounded queue of serialized messages waiting for the websocket thread. Message
+// kinds that carry a complete snapshot of some state are coalesced: a newer message
+// replaces the queued one in place, so the latest result keeps the earlier queue
+// position instead of waiting behind its own stale copies. When the message or byte
+// cap is exceeded the oldest messages are dropped, bulk lane first.
+//
+// Each kind belongs to a lane. pop() takes control messages ahead of bulk ones, but
+// lets a bulk message through after a run of control messages or once the oldest
+// bulk message has waited too long, so the bulk lane can't starve.
+
+class OutboundQueue {
+public:
+    static const unsigned num_lanes = 2;
+    static const unsigned num_kinds = (unsigned) MessageKind::CameraPipelineStats + 1;
+
+    struct Message {
+        MessageKind kind;
+        bool binary;
+        MessageBuffer *buffer;
+        uint64_t queued_nsec;
+    };
+
+    struct Stats {
+        uint64_t queued;
+        uint64_t sent;
+        uint64_t frames;        // Websocket frames written; sent / frames is the batching rate
+        uint64_t replaced;
+        uint64_t dropped;
+        uint64_t sent_by_lane[num_lanes];
+        uint64_t bulk_promoted; // Bulk messages sent ahead of waiting control messages
+        uint64_t sent_by_kind[num_kinds];
+        uint64_t bytes_by_kind[num_kinds];
+    };
+
+    OutboundQueue(size_t max_messages = 64, size_t max_bytes = 4 * 1024 * 1024);
+    ~OutboundQueue();
+
+    static bool is_coalesced(MessageKind kind);
+    static MessageLane lane_for(MessageKind kind);
+    static const char *kind_name(MessageKind kind);
+
+    // Takes ownership of the buffer. Returns true if the queue was empty.
+    bool push(MessageKind kind, MessageBuffer *buffer, bool binary = false);
+
+    // With allow_bulk false, only control messages are returned.
+    bool pop(Message &msg, bool allow_bulk = true);
+    void clear();
+    void count_dropped();
+    void count_frame();
+    size_t get_pending_bytes();
+    size_t get_pending_count();
+
+    Stats get_stats();
+
+    // Time from push to pop, per lane
+    LatencyHistogram::Snapshot get_latency(MessageLane lane);
+
+private:
+    std::mutex mutex;
+    std::deque<Message> lanes[num_lanes];
+    size_t max_messages;
+    size_t max_bytes;
+    size_t count;
+    size_t bytes;
+    unsigned control_run;
+    Stats stats;
+    LatencyHistogram latency[num_lanes];
+
+    void drop_oldest();
+};
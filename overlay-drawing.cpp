@@ -1,16 +1,52 @@
 #include "overlay-drawing.h"
-#include "json-util.h"
+#include <util/platform.h>
 #include <algorithm>
 #include <assert.h>
+#include <math.h>
 
 #define LOG_PREFIX      "OverlayDrawing: "
+#define VERTS_PER_QUAD  4
+#define MAX_VERTICES    (1024 * 1024 * 4)
+
+// Local layer entries nobody refreshes disappear after this long
+#define LOCAL_OVERLAY_TIMEOUT_NSEC  1000000000ULL
 
 OverlayDrawing::OverlayDrawing()
-    : effect(0),
-      draw_buffer(0)
+    : pending_texture(nullptr),
+      effect(0),
+      middle_buffer(1),
+      write_buffer(0),
+      write_quads(0),
+      render_buffer(2),
+      model(MAX_VERTICES / VERTS_PER_QUAD),
+      published_serial(0),
+      vb(0),
+      vb_data(0),
+      vb_capacity(0),
+      quad_indices(0),
+      quad_indices_capacity(0),
+      local_changed(false),
+      local_tracked(false),
+      local_tracked_nsec(0),
+      local_detections_nsec(0),
+      local_vb(0),
+      local_vb_data(0),
+      local_vb_capacity(0),
+      local_quads(0),
+      local_built_tracked(false),
+      local_built_detections(false),
+      local_built_scale(0.0)
 {
     memset(&texture_img, 0, sizeof texture_img);
     memset(&buffers, 0, sizeof buffers);
+    memset(&local_style, 0, sizeof local_style);
+    memset(local_tracked_rect, 0, sizeof local_tracked_rect);
+
+    texture_work = new asio::io_service::work(texture_io);
+    texture_watcher = new FileWatcher(texture_io, std::bind(&OverlayDrawing::load_texture, this));
+    texture_thread = std::thread([=] () {
+        texture_io.run();
+    });
 
     obs_enter_graphics();
     effect = gs_effect_create_from_file(obs_module_file("overlay.effect"), NULL);
@@ -22,18 +58,38 @@ OverlayDrawing::OverlayDrawing()
 
 OverlayDrawing::~OverlayDrawing()
 {
+    delete texture_work;
+    texture_io.stop();
+    texture_thread.join();
+    delete texture_watcher;
+
+    gs_image_file_t *pending = pending_texture.exchange(nullptr);
+    if (pending) {
+        free_image(pending);
+    }
+
     obs_enter_graphics();
 
     gs_image_file_free(&texture_img);
     gs_effect_destroy(effect);
 
-    for (uint32_t i = 0; i < num_buffers; i++) {
-        if (buffers[i].vb) {
-            gs_vertexbuffer_destroy(buffers[i].vb);
-        }
+    if (vb) {
+        gs_vertexbuffer_destroy(vb);
+    }
+    if (local_vb) {
+        gs_vertexbuffer_destroy(local_vb);
+    }
+    if (quad_indices) {
+        gs_indexbuffer_destroy(quad_indices);
     }
 
     obs_leave_graphics();
+
+    for (uint32_t i = 0; i < num_buffers; i++) {
+        if (buffers[i].vbd) {
+            gs_vbdata_destroy(buffers[i].vbd);
+        }
+    }
 }
 
 void OverlayDrawing::set_texture_file_path(const char *path)
@@ -41,144 +97,470 @@ void OverlayDrawing::set_texture_file_path(const char *path)
     if (texture_path.compare(path)) {
         texture_path = path;
 
-        obs_enter_graphics();
+        std::string new_path = path;
+        texture_io.post([=] () {
+            loader_path = new_path;
+            texture_watcher->watch(loader_path);
+            load_texture();
+        });
+    }
+}
+
+void OverlayDrawing::load_texture()
+{
+    // Loader thread. Decoding needs no graphics context, only the upload does.
+    if (loader_path.empty()) {
+        return;
+    }
+
+    gs_image_file_t *image = (gs_image_file_t*) bzalloc(sizeof(gs_image_file_t));
+    gs_image_file_init(image, loader_path.c_str());
+    if (!image->loaded) {
+        // Often a save in progress; the watcher will call again when it's done
+        blog(LOG_WARNING, LOG_PREFIX "Can't load texture %s", loader_path.c_str());
+        free_image(image);
+        return;
+    }
+
+    gs_image_file_t *superseded = pending_texture.exchange(image);
+    if (superseded) {
+        free_image(superseded);
+    }
+}
 
+void OverlayDrawing::upload_pending_texture()
+{
+    // Graphics thread
+    gs_image_file_t *image = pending_texture.exchange(nullptr);
+    if (image) {
+        gs_image_file_init_texture(image);
         gs_image_file_free(&texture_img);
-        gs_image_file_init(&texture_img, texture_path.c_str());
-        gs_image_file_init_texture(&texture_img);
+        texture_img = *image;
+        bfree(image);
+    }
+}
+
+void OverlayDrawing::free_image(gs_image_file_t *image)
+{
+    // CPU side only; images here never have a texture yet
+    gs_image_file_free(image);
+    bfree(image);
+}
 
-        obs_leave_graphics();
+void OverlayDrawing::begin_scene()
+{
+    write_quads = 0;
+    buffers[write_buffer].serial = 0;
+    model.begin_replace();
+}
+
+bool OverlayDrawing::grow_write_buffer(uint32_t num_vertices_needed, uint32_t num_vertices_kept)
+{
+    // Scene sizes aren't known until the end, so grow geometrically while writing.
+    // These are plain CPU arrays; the GPU buffer catches up in render().
+    if (num_vertices_needed > MAX_VERTICES) {
+        return false;
+    }
+
+    uint32_t old_capacity = buffers[write_buffer].capacity;
+    uint32_t padded_size = std::max((num_vertices_needed + 1024) & ~511, old_capacity * 2);
+    padded_size = std::min<uint32_t>(padded_size, MAX_VERTICES);
+
+    gs_vb_data *vbd = create_vbdata(padded_size);
+    gs_vb_data *old_vbd = buffers[write_buffer].vbd;
+    if (old_vbd) {
+        if (num_vertices_kept) {
+            memcpy(vbd->points, old_vbd->points, sizeof(vec3) * num_vertices_kept);
+            memcpy(vbd->colors, old_vbd->colors, sizeof(uint32_t) * num_vertices_kept);
+            memcpy(vbd->tvarray[0].array, old_vbd->tvarray[0].array, sizeof(vec2) * num_vertices_kept);
+        }
+        gs_vbdata_destroy(old_vbd);
+    }
+
+    buffers[write_buffer].vbd = vbd;
+    buffers[write_buffer].capacity = padded_size;
+    return true;
+}
+
+void OverlayDrawing::write_quad(gs_vb_data *vbd, uint32_t slot, OverlayQuad const &quad)
+{
+    uint32_t vert_i = slot * VERTS_PER_QUAD;
+    vec3 *points = &vbd->points[vert_i];
+    uint32_t *colors = &vbd->colors[vert_i];
+    vec2 *texcoord = &((vec2*)vbd->tvarray[0].array)[vert_i];
+    const double *src = quad.src;
+    const double *dest = quad.dest;
+
+    for (unsigned i = 0; i < VERTS_PER_QUAD; i++) {
+        colors[i] = quad.color;
     }
-    texture_path = path;
+
+    vec2_set(&texcoord[0], (float)src[0],          (float)src[1]);
+    vec2_set(&texcoord[1], (float)(src[0]+src[2]), (float)src[1]);
+    vec2_set(&texcoord[2], (float)src[0],          (float)(src[1]+src[3]));
+    vec2_set(&texcoord[3], (float)(src[0]+src[2]), (float)(src[1]+src[3]));
+
+    vec3_set(&points[0], (float)dest[0],           (float)dest[1], 0.0f);
+    vec3_set(&points[1], (float)(dest[0]+dest[2]), (float)dest[1], 0.0f);
+    vec3_set(&points[2], (float)dest[0],           (float)(dest[1]+dest[3]), 0.0f);
+    vec3_set(&points[3], (float)(dest[0]+dest[2]), (float)(dest[1]+dest[3]), 0.0f);
 }
 
-void OverlayDrawing::update_scene(rapidjson::Value const &scene)
+void OverlayDrawing::add_quad(OverlayQuad const &quad)
 {
-    const unsigned max_vertex_limit = 1024 * 1024 * 4;
-    const unsigned verts_per_scene_item = 6;
-    unsigned scene_size = scene.Size();
-    if (scene_size > max_vertex_limit / verts_per_scene_item) {
+    uint32_t vert_i = write_quads * VERTS_PER_QUAD;
+    if (vert_i + VERTS_PER_QUAD > buffers[write_buffer].capacity &&
+        !grow_write_buffer(vert_i + VERTS_PER_QUAD, vert_i)) {
         return;
     }
-    unsigned num_vertices_needed = scene_size * verts_per_scene_item;
 
-    // If we need to reallocate vertex buffers, take the (contentious, slow) graphics lock
-    unsigned next_buffer = (draw_buffer.load() + 1) % num_buffers;
-    if (!buffers[next_buffer].vb || num_vertices_needed > buffers[next_buffer].vbd->num) {
+    model.stage(quad);
+    write_quad(buffers[write_buffer].vbd, write_quads, quad);
+    write_quads++;
+}
 
-        obs_enter_graphics();
+void OverlayDrawing::end_scene(bool complete)
+{
+    if (complete) {
+        model.commit_replace();
+        buffers[write_buffer].num_quads = write_quads;
+        buffers[write_buffer].serial = model.get_serial();
+    } else {
+        // The write buffer was partly overwritten; it's rebuilt from the model if needed
+        model.abort_replace();
+    }
+}
 
-        // Round sizes up some to reallocate less frequently
-        uint32_t padded_size = (num_vertices_needed + 1024) & ~511;
-        blog(LOG_INFO, LOG_PREFIX "Resizing VB#%d to %d", next_buffer, padded_size);
+void OverlayDrawing::set_scene_version(uint32_t version)
+{
+    model.set_version(version);
+}
 
-        if (buffers[next_buffer].vb) {
-            gs_vertexbuffer_destroy(buffers[next_buffer].vb);
-        }
-        buffers[next_buffer].vbd = create_vbdata(padded_size);
-        buffers[next_buffer].vb = gs_vertexbuffer_create(buffers[next_buffer].vbd, GS_DYNAMIC);
-        buffers[next_buffer].draw_len = 0;
+uint32_t OverlayDrawing::get_scene_version()
+{
+    return model.get_version();
+}
+
+bool OverlayDrawing::apply_delta(OverlaySceneDelta const &delta)
+{
+    return model.apply(delta);
+}
 
-        obs_leave_graphics();
+bool OverlayDrawing::sync_write_buffer()
+{
+    // Patch the write buffer from the model, rewriting only slots changed since it was last synced
+    uint32_t num_slots = model.get_slot_count();
+    uint32_t num_kept = buffers[write_buffer].serial ? buffers[write_buffer].num_quads * VERTS_PER_QUAD : 0;
+    if (num_slots * VERTS_PER_QUAD > buffers[write_buffer].capacity &&
+        !grow_write_buffer(num_slots * VERTS_PER_QUAD, num_kept)) {
+        return false;
     }
 
-    gs_vb_data *vbd = buffers[next_buffer].vbd;
-    unsigned vert_i = 0;
+    changed_slots.clear();
+    if (buffers[write_buffer].serial && model.get_changes(buffers[write_buffer].serial, changed_slots)) {
+        for (uint32_t slot : changed_slots) {
+            if (slot < num_slots) {
+                write_quad(buffers[write_buffer].vbd, slot, model.get_slot(slot));
+            }
+        }
+    } else {
+        for (uint32_t slot = 0; slot < num_slots; slot++) {
+            write_quad(buffers[write_buffer].vbd, slot, model.get_slot(slot));
+        }
+    }
+
+    buffers[write_buffer].num_quads = num_slots;
+    buffers[write_buffer].serial = model.get_serial();
+    return true;
+}
+
+bool OverlayDrawing::publish_scene()
+{
+    if (model.get_serial() == published_serial) {
+        return false;
+    }
+    if (buffers[write_buffer].serial != model.get_serial() && !sync_write_buffer()) {
+        return false;
+    }
 
-    for (unsigned scene_i = 0; scene_i < scene_size; scene_i++) {
-        rapidjson::Value const &item = scene[scene_i];
+    assert(buffers[write_buffer].num_quads * VERTS_PER_QUAD <= buffers[write_buffer].capacity);
+    buffers[write_buffer].dirty = true;
+    published_serial = model.get_serial();
 
-        double src[4], dest[4], rgba[4];
+    // Publish, and take back whichever buffer was in the middle. If the renderer
+    // never picked that one up, it was a superseded scene and is simply reused.
+    write_buffer = middle_buffer.exchange(write_buffer | fresh_bit) & ~fresh_bit;
+    write_quads = 0;
 
-        json_vec4(item, "src", src);
-        json_vec4(item, "dest", dest);
-        json_vec4(item, "rgba", rgba);
+    // The log only has to reach back to the stalest buffer
+    uint64_t oldest = published_serial;
+    for (uint32_t i = 0; i < num_buffers; i++) {
+        if (buffers[i].serial) {
+            oldest = std::min(oldest, buffers[i].serial);
+        }
+    }
+    model.trim_changes(oldest);
+    return true;
+}
 
-        uint8_t r8 = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[0] * 255.0)));
-        uint8_t g8 = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[1] * 255.0)));
-        uint8_t b8 = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[2] * 255.0)));
-        uint8_t a8 = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[3] * 255.0)));
-        uint32_t color = r8 | (g8 << 8) | (b8 << 16) | (a8 << 24);
+void OverlayDrawing::set_local_style(LocalOverlayStyle const &style)
+{
+    std::lock_guard<std::mutex> lock(local_mutex);
+    local_style = style;
+    local_changed = true;
+}
 
-        vec2 tex_topleft, tex_topright, tex_botleft, tex_botright;
-        vec3 dst_topleft, dst_topright, dst_botleft, dst_botright;
+void OverlayDrawing::show_tracked_region(const double rect[4])
+{
+    std::lock_guard<std::mutex> lock(local_mutex);
+    memcpy(local_tracked_rect, rect, sizeof local_tracked_rect);
+    local_tracked = true;
+    local_tracked_nsec = os_gettime_ns();
+    local_changed = true;
+}
 
-        vec2_set(&tex_topleft,  (float)src[0],          (float)src[1]);
-        vec2_set(&tex_topright, (float)(src[0]+src[2]), (float)src[1]);
-        vec2_set(&tex_botleft,  (float)src[0],          (float)(src[1]+src[3]));
-        vec2_set(&tex_botright, (float)(src[0]+src[2]), (float)(src[1]+src[3]));
+void OverlayDrawing::hide_tracked_region()
+{
+    std::lock_guard<std::mutex> lock(local_mutex);
+    local_changed = local_changed || local_tracked;
+    local_tracked = false;
+}
 
-        vec3_set(&dst_topleft,  (float)dest[0],           (float)dest[1], 0.0f);
-        vec3_set(&dst_topright, (float)(dest[0]+dest[2]), (float)dest[1], 0.0f);
-        vec3_set(&dst_botleft,  (float)dest[0],           (float)(dest[1]+dest[3]), 0.0f);
-        vec3_set(&dst_botright, (float)(dest[0]+dest[2]), (float)(dest[1]+dest[3]), 0.0f);
+void OverlayDrawing::show_detections(ObjectDetectionResult const &result)
+{
+    std::lock_guard<std::mutex> lock(local_mutex);
+    local_detections.clear();
+    for (DetectedObject const &obj : result.objects) {
+        if (obj.prob >= local_style.min_prob) {
+            local_detections.push_back(obj);
+        }
+    }
+    local_detections_nsec = os_gettime_ns();
+    local_changed = true;
+}
 
-        vec3 *points = &vbd->points[vert_i];
-        uint32_t *colors = &vbd->colors[vert_i];
-        vec2 *texcoord = &((vec2*)vbd->tvarray[0].array)[vert_i];
+void OverlayDrawing::add_outline(const double rect[4], double width, uint32_t color)
+{
+    // Four solid quads just inside the rectangle's edges
+    double w = std::min(width, std::min(fabs(rect[2]), fabs(rect[3])) / 2.0);
+    double x = rect[2] < 0 ? rect[0] + rect[2] : rect[0];
+    double y = rect[3] < 0 ? rect[1] + rect[3] : rect[1];
+    double rw = fabs(rect[2]), rh = fabs(rect[3]);
+    const double edges[4][4] = {
+        { x,          y,          rw, w },
+        { x,          y + rh - w, rw, w },
+        { x,          y + w,      w,  rh - 2 * w },
+        { x + rw - w, y + w,      w,  rh - 2 * w },
+    };
+
+    for (unsigned i = 0; i < 4; i++) {
+        OverlayQuad quad;
+        memset(&quad, 0, sizeof quad);
+        memcpy(quad.dest, edges[i], sizeof quad.dest);
+        quad.color = color;
+        local_outlines.push_back(quad);
+    }
+}
 
-        for (unsigned i = 0; i < verts_per_scene_item; i++) {
-            colors[i] = color;
+uint32_t OverlayDrawing::prepare_local(obs_source_t *source)
+{
+    // Graphics thread. Returns the number of local quads ready to draw.
+    uint32_t source_width = obs_source_get_width(source);
+    if (!source_width) {
+        return 0;
+    }
+    // Overlay coordinates span [-1, 1] horizontally
+    double px_scale = 2.0 / source_width;
+    uint64_t now = os_gettime_ns();
+
+    {
+        std::lock_guard<std::mutex> lock(local_mutex);
+        bool tracked = local_style.show_tracked && local_tracked &&
+            now - local_tracked_nsec < LOCAL_OVERLAY_TIMEOUT_NSEC;
+        bool detections = local_style.show_detected && !local_detections.empty() &&
+            now - local_detections_nsec < LOCAL_OVERLAY_TIMEOUT_NSEC;
+
+        if (!local_changed && tracked == local_built_tracked &&
+            detections == local_built_detections && px_scale == local_built_scale) {
+            return local_quads;
         }
 
-        points[0] = dst_topleft;  texcoord[0] = tex_topleft;
-        points[1] = dst_topright; texcoord[1] = tex_topright;
-        points[2] = dst_botleft;  texcoord[2] = tex_botleft;
+        local_changed = false;
+        local_built_tracked = tracked;
+        local_built_detections = detections;
+        local_built_scale = px_scale;
+
+        // Detections underneath, the tracked region on top
+        double width = local_style.line_width_px * px_scale;
+        local_outlines.clear();
+        if (detections) {
+            for (DetectedObject const &obj : local_detections) {
+                add_outline(obj.rect, width, local_style.detected_color);
+            }
+        }
+        if (tracked) {
+            add_outline(local_tracked_rect, width, local_style.tracked_color);
+        }
+    }
 
-        points[3] = dst_topright; texcoord[3] = tex_topright;
-        points[4] = dst_botright; texcoord[4] = tex_botright;
-        points[5] = dst_botleft;  texcoord[5] = tex_botleft;
+    local_quads = (uint32_t) local_outlines.size();
+    if (!local_quads) {
+        return 0;
+    }
 
-        vert_i += verts_per_scene_item;
+    uint32_t num_vertices = local_quads * VERTS_PER_QUAD;
+    if (!local_vb || num_vertices > local_vb_capacity) {
+        if (local_vb) {
+            gs_vertexbuffer_destroy(local_vb);
+        }
+        local_vb_capacity = std::max<uint32_t>(num_vertices * 2, 256);
+        local_vb_data = create_vbdata(local_vb_capacity);
+        local_vb = gs_vertexbuffer_create(local_vb_data, GS_DYNAMIC);
+        if (!local_vb) {
+            local_vb_capacity = 0;
+            local_quads = 0;
+            return 0;
+        }
+        reserve_quad_indices(local_vb_capacity / VERTS_PER_QUAD);
     }
 
-    assert(vert_i == num_vertices_needed);
-    buffers[next_buffer].draw_len = num_vertices_needed;
-    assert(buffers[next_buffer].draw_len <= buffers[next_buffer].vbd->num);
-    draw_buffer.store(next_buffer);
+    for (uint32_t i = 0; i < local_quads; i++) {
+        write_quad(local_vb_data, i, local_outlines[i]);
+    }
+    local_vb_data->num = num_vertices;
+    gs_vertexbuffer_flush(local_vb);
+    local_vb_data->num = local_vb_capacity;
+    return local_quads;
 }
 
-void OverlayDrawing::render(obs_source_t *source)
+uint32_t OverlayDrawing::prepare_scene()
 {
+    // Graphics thread. Returns the number of scene quads ready to draw.
     if (!texture_img.texture) {
-        return;
+        return 0;
     }
 
-    uint32_t buffer_index = draw_buffer.load();
-    gs_vertbuffer_t *vb = buffers[buffer_index].vb;
-    uint32_t draw_len = buffers[buffer_index].draw_len;
-    if (!vb || !draw_len) {
-        return;
+    if (middle_buffer.load() & fresh_bit) {
+        render_buffer = middle_buffer.exchange(render_buffer) & ~fresh_bit;
     }
 
-    gs_vertexbuffer_flush(vb);
-    gs_load_vertexbuffer(vb);
-    gs_load_indexbuffer(NULL);
+    uint32_t buffer_index = render_buffer;
+    uint32_t num_quads = buffers[buffer_index].num_quads;
+    if (!num_quads) {
+        return 0;
+    }
+    if (buffers[buffer_index].dirty) {
+        buffers[buffer_index].dirty = false;
+        if (!upload_vertices(buffer_index)) {
+            return 0;
+        }
+    }
+    return vb && quad_indices ? num_quads : 0;
+}
+
+void OverlayDrawing::render(obs_source_t *source)
+{
+    upload_pending_texture();
+
+    uint32_t num_quads = prepare_scene();
+    uint32_t num_local = prepare_local(source);
+    if ((!num_quads && !num_local) || !quad_indices) {
+        return;
+    }
 
     gs_blend_state_push();
     gs_enable_blending(true);
     gs_blend_function(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA);
     gs_enable_color(true, true, true, false);
+    gs_load_indexbuffer(quad_indices);
+
+    vec2 image_size;
+    vec2_set(&image_size, texture_img.cx, texture_img.cy);
+
+    vec2 source_size;
+    vec2_set(&source_size,
+        obs_source_get_width(source),
+        obs_source_get_height(source));
+
+    if (num_quads) {
+        gs_load_vertexbuffer(vb);
+        while (gs_effect_loop(effect, "Draw")) {
+            gs_effect_set_texture(image_param, texture_img.texture);
+            gs_effect_set_vec2(image_size_param, &image_size);
+            gs_effect_set_vec2(source_size_param, &source_size);
+            gs_draw(GS_TRIS, 0, num_quads * 6);
+        }
+    }
 
-    while (gs_effect_loop(effect, "Draw")) {
+    if (num_local) {
+        gs_load_vertexbuffer(local_vb);
+        while (gs_effect_loop(effect, "DrawSolid")) {
+            gs_effect_set_vec2(source_size_param, &source_size);
+            gs_draw(GS_TRIS, 0, num_local * 6);
+        }
+    }
 
-        gs_effect_set_texture(image_param, texture_img.texture);
+    gs_enable_color(true, true, true, true);
+    gs_blend_state_pop();
+}
 
-        vec2 image_size;
-        vec2_set(&image_size, texture_img.cx, texture_img.cy);
-        gs_effect_set_vec2(image_size_param, &image_size);
+bool OverlayDrawing::upload_vertices(uint32_t buffer_index)
+{
+    // Graphics thread. Upload once per new scene, and only the vertices it uses.
+    uint32_t num_vertices = buffers[buffer_index].num_quads * VERTS_PER_QUAD;
+    gs_vb_data *src = buffers[buffer_index].vbd;
+
+    if (!vb || num_vertices > vb_capacity) {
+        // Grown the same way as the CPU arrays, so this settles quickly
+        uint32_t padded_size = std::max((num_vertices + 1024) & ~511, vb_capacity * 2);
+        padded_size = std::min<uint32_t>(padded_size, MAX_VERTICES);
+        blog(LOG_INFO, LOG_PREFIX "Resizing vertex buffer to %d", padded_size);
+
+        if (vb) {
+            // Also frees vb_data
+            gs_vertexbuffer_destroy(vb);
+        }
+        vb_data = create_vbdata(padded_size);
+        vb = gs_vertexbuffer_create(vb_data, GS_DYNAMIC);
+        vb_capacity = vb ? padded_size : 0;
+        if (!vb) {
+            blog(LOG_ERROR, LOG_PREFIX "Can't create vertex buffer");
+            return false;
+        }
+        reserve_quad_indices(padded_size / VERTS_PER_QUAD);
+    }
 
-        vec2 source_size;
-        vec2_set(&source_size,
-            obs_source_get_width(source),
-            obs_source_get_height(source));
-        gs_effect_set_vec2(source_size_param, &source_size);
+    // The flush copies vb_data->num vertices, so narrow that to the used range for the duration
+    memcpy(vb_data->points, src->points, sizeof(vec3) * num_vertices);
+    memcpy(vb_data->colors, src->colors, sizeof(uint32_t) * num_vertices);
+    memcpy(vb_data->tvarray[0].array, src->tvarray[0].array, sizeof(vec2) * num_vertices);
+    vb_data->num = num_vertices;
+    gs_vertexbuffer_flush(vb);
+    vb_data->num = vb_capacity;
+    return true;
+}
 
-        gs_draw(GS_TRIS, 0, draw_len);
+void OverlayDrawing::reserve_quad_indices(uint32_t num_quads)
+{
+    // Graphics thread
+    if (num_quads <= quad_indices_capacity) {
+        return;
     }
 
-    gs_enable_color(true, true, true, true);
-    gs_blend_state_pop();
+    uint32_t *indices = (uint32_t*) bmalloc(sizeof(uint32_t) * 6 * num_quads);
+    for (uint32_t quad = 0; quad < num_quads; quad++) {
+        uint32_t *tri = &indices[quad * 6];
+        uint32_t vert = quad * 4;
+        tri[0] = vert + 0; tri[1] = vert + 1; tri[2] = vert + 2;
+        tri[3] = vert + 1; tri[4] = vert + 3; tri[5] = vert + 2;
+    }
+
+    if (quad_indices) {
+        gs_indexbuffer_destroy(quad_indices);
+    }
+    // The index buffer takes ownership of 'indices'
+    quad_indices = gs_indexbuffer_create(GS_UNSIGNED_LONG, indices, 6 * num_quads, 0);
+    quad_indices_capacity = num_quads;
 }
 
 gs_vb_data *OverlayDrawing::create_vbdata(unsigned new_size)
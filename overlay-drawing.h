@@ -4,7 +4,11 @@
 #include <string>
 #include <atomic>
 #include <mutex>
-#include <rapidjson/document.h>
+#include <thread>
+#include <vector>
+#include "file-watcher.h"
+#include "overlay-scene-model.h"
+#include "vision-messages.h"
 
 extern "C" {
 #include <graphics/graphics.h>
@@ -12,32 +16,129 @@ extern "C" {
 #include <graphics/image-file.h>
 }
 
-class OverlayDrawing {
+// Appearance of the local layer. Colors are RGBA8 like scene quads; OBS color
+// properties use the same byte order.
+struct LocalOverlayStyle {
+    bool show_tracked;
+    bool show_detected;
+    uint32_t tracked_color;
+    uint32_t detected_color;
+    double line_width_px;
+    double min_prob;
+};
+
+class OverlayDrawing : public OverlaySceneSink {
 public:
     OverlayDrawing();
     ~OverlayDrawing();
 
     void set_texture_file_path(const char *path);
-    void update_scene(rapidjson::Value const &scene);
+
+    // Scenes are written quad by quad as they are parsed, from one writer thread
+    void begin_scene() override;
+    void add_quad(OverlayQuad const &quad) override;
+    void end_scene(bool complete) override;
+    bool publish_scene() override;
+
+    void set_scene_version(uint32_t version) override;
+    uint32_t get_scene_version() override;
+    bool apply_delta(OverlaySceneDelta const &delta) override;
+
+    // Local layer, drawn over the controller's scene straight from this machine's
+    // vision results, so boxes keep up with the video without a network round trip.
+    // May be called from any thread.
+    void set_local_style(LocalOverlayStyle const &style);
+    void show_tracked_region(const double rect[4]);
+    void hide_tracked_region();
+    void show_detections(ObjectDetectionResult const &result);
 
     void render(obs_source_t *source);
 
 private:
     std::string texture_path;
 
+    // Texture images are decoded on a loader thread, which also watches the file
+    // for changes. The finished image waits in 'pending_texture' until render()
+    // uploads it; the previous texture stays in use until then.
+    asio::io_service texture_io;
+    asio::io_service::work *texture_work;
+    FileWatcher *texture_watcher;
+    std::thread texture_thread;
+    std::string loader_path;
+    std::atomic<gs_image_file_t*> pending_texture;
+
     gs_image_file_t texture_img;
     gs_effect_t *effect;
     gs_eparam_t *image_param;
     gs_eparam_t *image_size_param;
     gs_eparam_t *source_size_param;
 
-    static constexpr uint32_t num_buffers = 2;
-    std::atomic<uint32_t> draw_buffer;
+    // Triple-buffered mailbox of CPU-side vertex arrays between the scene writer
+    // thread and render. Each side owns one buffer outright; the third sits in 'middle', tagged as
+    // fresh once the writer has published it. The writer swaps its finished buffer
+    // into the middle, the renderer swaps its buffer for a fresh middle one, and
+    // neither ever waits for or touches the other's buffer.
+    static constexpr uint32_t num_buffers = 3;
+    static constexpr uint32_t fresh_bit = 0x80000000;
+    std::atomic<uint32_t> middle_buffer;
+    uint32_t write_buffer;
+    uint32_t write_quads;
+    uint32_t render_buffer;
     struct {
-        gs_vertbuffer_t *vb;
-        gs_vb_data *vbd;
-        uint32_t draw_len;
+        gs_vb_data *vbd;        // Not attached to any vertex buffer
+        uint32_t capacity;      // Vertices allocated in vbd
+        uint32_t num_quads;
+        bool dirty;             // Not uploaded yet
+        uint64_t serial;        // Model serial the contents match; 0 if unknown. Writer only.
     } buffers[num_buffers];
 
+    // Writer side. Full scenes are written straight into the write buffer as well as
+    // the model; deltas only change the model, and the write buffer catches up by
+    // rewriting the changed slots when it's published.
+    OverlaySceneModel model;
+    uint64_t published_serial;
+    std::vector<uint32_t> changed_slots;
+
+    // Graphics objects belong to the render thread, which creates and grows them as
+    // scenes need; the writer never takes the graphics lock. Every quad is 4 vertices,
+    // and a static index buffer, only ever grown, turns them into two triangles each.
+    gs_vertbuffer_t *vb;
+    gs_vb_data *vb_data;        // Owned by vb
+    uint32_t vb_capacity;
+    gs_indexbuffer_t *quad_indices;
+    uint32_t quad_indices_capacity;
+
+    // Local layer inputs, from the vision threads
+    std::mutex local_mutex;
+    LocalOverlayStyle local_style;
+    bool local_changed;
+    bool local_tracked;
+    double local_tracked_rect[4];
+    uint64_t local_tracked_nsec;
+    std::vector<DetectedObject> local_detections;
+    uint64_t local_detections_nsec;
+
+    // Local layer outlines, rebuilt by render() when the inputs change or expire
+    gs_vertbuffer_t *local_vb;
+    gs_vb_data *local_vb_data;  // Owned by local_vb
+    uint32_t local_vb_capacity;
+    uint32_t local_quads;
+    bool local_built_tracked;
+    bool local_built_detections;
+    double local_built_scale;
+    std::vector<OverlayQuad> local_outlines;
+
+    void load_texture();
+    void upload_pending_texture();
+    static void free_image(gs_image_file_t *image);
+
     gs_vb_data *create_vbdata(unsigned new_size);
+    bool grow_write_buffer(uint32_t num_vertices_needed, uint32_t num_vertices_kept);
+    static void write_quad(gs_vb_data *vbd, uint32_t slot, OverlayQuad const &quad);
+    bool sync_write_buffer();
+    bool upload_vertices(uint32_t buffer_index);
+    uint32_t prepare_scene();
+    uint32_t prepare_local(obs_source_t *source);
+    void add_outline(const double rect[4], double width, uint32_t color);
+    void reserve_quad_indices(uint32_t num_quads);
 };
@@ -0,0 +1,264 @@
+#include "overlay-scene-model.h"
+#include "vision-messages.h"
+#include "json-util.h"
+#include <algorithm>
+
+// Compact once this many removed items are left, and they're over a quarter of the slots
+#define MIN_COMPACT_HOLES           64
+
+// Past this many log entries beyond the slot count, a full rewrite is as cheap
+#define MAX_EXTRA_CHANGES           4096
+
+#define BINARY_DELTA_FIXED_SIZE     24
+#define BINARY_DELTA_ITEM_SIZE      40
+
+OverlaySceneModel::OverlaySceneModel(uint32_t max_slots)
+    : max_slots(max_slots),
+      version(0),
+      serial(1),
+      full_serial(1),
+      holes(0)
+{
+}
+
+void OverlaySceneModel::begin_replace()
+{
+    staged.clear();
+}
+
+void OverlaySceneModel::stage(OverlayQuad const &quad)
+{
+    if (staged.size() < max_slots) {
+        staged.push_back(quad);
+    }
+}
+
+void OverlaySceneModel::commit_replace()
+{
+    slots.swap(staged);
+    staged.clear();
+    version = 0;
+    holes = 0;
+    serial++;
+    rewrite_all();
+}
+
+void OverlaySceneModel::abort_replace()
+{
+    staged.clear();
+}
+
+void OverlaySceneModel::rewrite_all()
+{
+    full_serial = serial;
+    changes.clear();
+    slot_by_id.clear();
+    for (uint32_t slot = 0; slot < slots.size(); slot++) {
+        if (slots[slot].id != OVERLAY_NO_ID) {
+            slot_by_id[slots[slot].id] = slot;
+        }
+    }
+}
+
+void OverlaySceneModel::set_slot(uint32_t slot, OverlayQuad const &quad)
+{
+    slots[slot] = quad;
+    changes.push_back({ serial, slot });
+}
+
+bool OverlaySceneModel::apply(OverlaySceneDelta const &delta)
+{
+    if (delta.base != version) {
+        return false;
+    }
+
+    // Everything in one delta shares a serial
+    serial++;
+
+    for (uint32_t id : delta.removed) {
+        auto found = slot_by_id.find(id);
+        if (found != slot_by_id.end()) {
+            OverlayQuad empty;
+            memset(&empty, 0, sizeof empty);
+            set_slot(found->second, empty);
+            slot_by_id.erase(found);
+            holes++;
+        }
+    }
+
+    // Updates to unknown items and inserts of known ones are both taken as meant
+    for (auto list : { &delta.updated, &delta.inserted }) {
+        for (OverlayQuad const &quad : *list) {
+            if (quad.id == OVERLAY_NO_ID) {
+                continue;
+            }
+            auto found = slot_by_id.find(quad.id);
+            if (found != slot_by_id.end()) {
+                set_slot(found->second, quad);
+            } else if (slots.size() < max_slots) {
+                uint32_t slot = (uint32_t) slots.size();
+                slots.push_back(quad);
+                changes.push_back({ serial, slot });
+                slot_by_id[quad.id] = slot;
+            }
+        }
+    }
+
+    version = delta.version;
+
+    if (holes >= MIN_COMPACT_HOLES && holes * 4 > slots.size()) {
+        compact();
+    } else if (changes.size() > slots.size() + MAX_EXTRA_CHANGES) {
+        rewrite_all();
+    }
+    return true;
+}
+
+void OverlaySceneModel::compact()
+{
+    // Removed items are the anonymous empty slots. Any other anonymous empty slot
+    // draws nothing and can't be named by a delta, so it goes too.
+    auto removed = std::remove_if(slots.begin(), slots.end(), [] (OverlayQuad const &quad) {
+        return quad.id == OVERLAY_NO_ID && (quad.dest[2] == 0.0 || quad.dest[3] == 0.0);
+    });
+    slots.erase(removed, slots.end());
+    holes = 0;
+    rewrite_all();
+}
+
+bool OverlaySceneModel::get_changes(uint64_t since, std::vector<uint32_t> &changed) const
+{
+    if (since < full_serial) {
+        return false;
+    }
+    for (auto change = changes.rbegin(); change != changes.rend() && change->serial > since; ++change) {
+        changed.push_back(change->slot);
+    }
+    return true;
+}
+
+void OverlaySceneModel::trim_changes(uint64_t oldest)
+{
+    auto first_needed = std::find_if(changes.begin(), changes.end(), [=] (Change const &change) {
+        return change.serial > oldest;
+    });
+    changes.erase(changes.begin(), first_needed);
+}
+
+static bool json_u32(rapidjson::Value const &value, uint32_t &out)
+{
+    if (!value.IsNumber() || value.GetDouble() < 0.0 || value.GetDouble() > 4294967295.0) {
+        return false;
+    }
+    out = (uint32_t) value.GetDouble();
+    return true;
+}
+
+static void decode_items(rapidjson::Value const &obj, const char *member, std::vector<OverlayQuad> &out)
+{
+    rapidjson::Value const *list = json_obj(obj, member);
+    if (!list || !list->IsArray()) {
+        return;
+    }
+    for (rapidjson::SizeType i = 0; i < list->Size(); i++) {
+        rapidjson::Value const &item = (*list)[i];
+        rapidjson::Value const *id = json_obj(item, "id");
+        OverlayQuad quad;
+        double rgba[4];
+        if (!id || !json_u32(*id, quad.id)) {
+            continue;
+        }
+        json_vec4(item, "src", quad.src);
+        json_vec4(item, "dest", quad.dest);
+        json_vec4(item, "rgba", rgba);
+        quad.color = pack_overlay_color(rgba);
+        out.push_back(quad);
+    }
+}
+
+bool decode_overlay_delta(rapidjson::Value const &obj, OverlaySceneDelta &delta)
+{
+    rapidjson::Value const *base = json_obj(obj, "base");
+    rapidjson::Value const *version = json_obj(obj, "version");
+    if (!base || !version || !json_u32(*base, delta.base) || !json_u32(*version, delta.version)) {
+        return false;
+    }
+
+    delta.removed.clear();
+    delta.updated.clear();
+    delta.inserted.clear();
+
+    rapidjson::Value const *removed = json_obj(obj, "remove");
+    if (removed && removed->IsArray()) {
+        for (rapidjson::SizeType i = 0; i < removed->Size(); i++) {
+            uint32_t id;
+            if (json_u32((*removed)[i], id)) {
+                delta.removed.push_back(id);
+            }
+        }
+    }
+    decode_items(obj, "update", delta.updated);
+    decode_items(obj, "insert", delta.inserted);
+    return true;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static double get_f32(const uint8_t *p)
+{
+    uint32_t bits = get_u32(p);
+    float f;
+    memcpy(&f, &bits, sizeof f);
+    return f;
+}
+
+static void get_items(const uint8_t *&p, uint32_t count, std::vector<OverlayQuad> &out)
+{
+    for (uint32_t i = 0; i < count; i++, p += BINARY_DELTA_ITEM_SIZE) {
+        OverlayQuad quad;
+        quad.id = get_u32(p);
+        for (unsigned c = 0; c < 4; c++) {
+            quad.src[c] = get_f32(p + 4 + c * 4);
+            quad.dest[c] = get_f32(p + 20 + c * 4);
+        }
+        quad.color = get_u32(p + 36);
+        if (quad.id != OVERLAY_NO_ID) {
+            out.push_back(quad);
+        }
+    }
+}
+
+bool decode_overlay_delta(const uint8_t *data, size_t size, OverlaySceneDelta &delta)
+{
+    if (size < BINARY_DELTA_FIXED_SIZE || data[0] != BINARY_OVERLAY_DELTA || data[1] != BINARY_MESSAGE_VERSION) {
+        return false;
+    }
+
+    const uint8_t *p = data + 4;
+    delta.base = get_u32(p);
+    delta.version = get_u32(p + 4);
+    uint32_t num_removed = get_u32(p + 8);
+    uint32_t num_updated = get_u32(p + 12);
+    uint32_t num_inserted = get_u32(p + 16);
+    p += 20;
+
+    uint64_t expected = BINARY_DELTA_FIXED_SIZE + 4ull * num_removed +
+        (uint64_t) BINARY_DELTA_ITEM_SIZE * ((uint64_t) num_updated + num_inserted);
+    if (expected != size) {
+        return false;
+    }
+
+    delta.removed.clear();
+    delta.updated.clear();
+    delta.inserted.clear();
+
+    for (uint32_t i = 0; i < num_removed; i++, p += 4) {
+        delta.removed.push_back(get_u32(p));
+    }
+    get_items(p, num_updated, delta.updated);
+    get_items(p, num_inserted, delta.inserted);
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "overlay-scene-parser.h"
+#include <rapidjson/document.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Authoritative copy of the overlay scene, kept on the scene writer thread so the
+// controller can send CameraOverlayDelta messages instead of whole scenes.
+//
+// Items live in slots and draw in slot order. A full scene fills slots in array
+// order; inserted items take new slots at the end, so they draw on top; removed
+// items leave a zero-sized quad behind until enough holes build up to compact.
+// Every change gets a serial number and a change log entry for its slot, so a copy
+// of the scene (one of the overlay's vertex buffers) is brought up to date by
+// rewriting only the slots changed since the serial it was last synced at.
+//
+// Deltas on the wire, with items shaped as in a full scene but always with an id:
+//
+//   JSON, in a Stream message:         {"CameraOverlayDelta": {"base": n, "version": n,
+//                                        "remove": [id, ...], "update": [item, ...],
+//                                        "insert": [item, ...]}}
+//   binary frame:                      header (vision-messages.h) with type
+//                                      BINARY_OVERLAY_DELTA and count 0, then
+//                                      u32 base, u32 version, u32 num_remove,
+//                                      u32 num_update, u32 num_insert, a u32 id per
+//                                      removal, then per update and insert:
+//                                      u32 id, f32 src[4], f32 dest[4], u8 rgba[4]
+//
+// A full scene may name its version in a "CameraOverlaySceneVersion" member next to
+// "CameraOverlayScene" in the same message. A delta whose base doesn't match is
+// refused, and the plugin asks for a full scene with CameraOverlayResync.
+
+class OverlaySceneModel {
+public:
+    OverlaySceneModel(uint32_t max_slots);
+
+    // Replacing the whole scene. Items are staged until the scene is known to be complete.
+    // Staging copies each quad once more besides the vertices the sink writes; the
+    // model needs exact items to apply deltas and to rebuild the other vertex
+    // buffers. Both vectors keep their capacity, so this doesn't allocate once warm.
+    void begin_replace();
+    void stage(OverlayQuad const &quad);
+    void commit_replace();
+    void abort_replace();
+
+    bool apply(OverlaySceneDelta const &delta);
+
+    uint32_t get_version() const { return version; }
+    void set_version(uint32_t new_version) { version = new_version; }
+    uint64_t get_serial() const { return serial; }
+    uint32_t get_slot_count() const { return (uint32_t) slots.size(); }
+    OverlayQuad const &get_slot(uint32_t slot) const { return slots[slot]; }
+
+    // Appends slots changed after serial 'since', possibly repeated. Returns false if
+    // the log doesn't reach back that far, in which case every slot has changed.
+    bool get_changes(uint64_t since, std::vector<uint32_t> &changed) const;
+
+    // Drop log entries that no copy synced at 'oldest' or later still needs
+    void trim_changes(uint64_t oldest);
+
+private:
+    struct Change {
+        uint64_t serial;
+        uint32_t slot;
+    };
+
+    uint32_t max_slots;
+    uint32_t version;
+    uint64_t serial;
+    uint64_t full_serial;       // Every slot counts as changed at this serial
+    uint32_t holes;
+    std::vector<OverlayQuad> slots;
+    std::vector<OverlayQuad> staged;
+    std::unordered_map<uint32_t, uint32_t> slot_by_id;
+    std::vector<Change> changes;
+
+    void set_slot(uint32_t slot, OverlayQuad const &quad);
+    void rewrite_all();
+    void compact();
+};
+
+bool decode_overlay_delta(rapidjson::Value const &obj, OverlaySceneDelta &delta);
+bool decode_overlay_delta(const uint8_t *data, size_t size, OverlaySceneDelta &delta);
@@ -0,0 +1,157 @@
+#include "overlay-scene-parser.h"
+#include <algorithm>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCENE_PARSER_SSE2
+#endif
+
+uint32_t pack_overlay_color(const double rgba[4])
+{
+#ifdef SCENE_PARSER_SSE2
+    // Two channels per register: scale, clamp, then add a half and
+    // truncate, which rounds the same way as round() for these non-negative values.
+    const __m128d scale = _mm_set1_pd(255.0);
+    const __m128d half = _mm_set1_pd(0.5);
+    __m128d rg = _mm_mul_pd(_mm_loadu_pd(rgba), scale);
+    __m128d ba = _mm_mul_pd(_mm_loadu_pd(rgba + 2), scale);
+    rg = _mm_add_pd(_mm_min_pd(_mm_max_pd(rg, _mm_setzero_pd()), scale), half);
+    ba = _mm_add_pd(_mm_min_pd(_mm_max_pd(ba, _mm_setzero_pd()), scale), half);
+    __m128i i = _mm_unpacklo_epi64(_mm_cvttpd_epi32(rg), _mm_cvttpd_epi32(ba));
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    return (uint32_t) _mm_cvtsi128_si32(i);
+#else
+    uint32_t color = 0;
+    for (unsigned c = 0; c < 4; c++) {
+        uint8_t byte = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[c] * 255.0)));
+        color |= (uint32_t) byte << (c * 8);
+    }
+    return color;
+#endif
+}
+
+OverlaySceneParser::OverlaySceneParser(unsigned max_quads)
+    : sink(0),
+      max_quads(max_quads),
+      depth(0),
+      finished(false),
+      valid(false),
+      item_is_object(false),
+      quad_count(0),
+      field(FIELD_NONE),
+      field_index(0),
+      item_id(OVERLAY_NO_ID)
+{
+    memset(item, 0, sizeof item);
+}
+
+void OverlaySceneParser::start(OverlaySceneSink *new_sink)
+{
+    sink = new_sink;
+    depth = 0;
+    finished = false;
+    valid = true;
+    quad_count = 0;
+}
+
+bool OverlaySceneParser::scalar(double v)
+{
+    if (depth == 2 && field == FIELD_ID) {
+        item_id = v >= 0.0 && v <= 4294967295.0 ? (uint32_t) v : OVERLAY_NO_ID;
+        field = FIELD_NONE;
+    }
+    // Depth 3 is inside an item's vec4; any other value there, even a container, reads as zero
+    if (depth == 3 && field <= FIELD_RGBA) {
+        if (field_index < 4) {
+            item[field][field_index] = v;
+        }
+        field_index++;
+    }
+    return true;
+}
+
+bool OverlaySceneParser::Key(const char *str, rapidjson::SizeType len, bool)
+{
+    if (depth == 2) {
+        field = FIELD_NONE;
+        if (len == 3 && !memcmp(str, "src", 3)) {
+            field = FIELD_SRC;
+        } else if (len == 4 && !memcmp(str, "dest", 4)) {
+            field = FIELD_DEST;
+        } else if (len == 4 && !memcmp(str, "rgba", 4)) {
+            field = FIELD_RGBA;
+        } else if (len == 2 && !memcmp(str, "id", 2)) {
+            field = FIELD_ID;
+        }
+    }
+    return true;
+}
+
+bool OverlaySceneParser::StartObject()
+{
+    scalar(0.0);
+    depth++;
+    if (depth == 2) {
+        memset(item, 0, sizeof item);
+        item_id = OVERLAY_NO_ID;
+        field = FIELD_NONE;
+        item_is_object = true;
+    }
+    return true;
+}
+
+bool OverlaySceneParser::EndObject(rapidjson::SizeType)
+{
+    if (depth == 2 && item_is_object) {
+        item_is_object = false;
+        if (++quad_count > max_quads) {
+            valid = false;
+        } else if (sink && valid) {
+            OverlayQuad quad;
+            memcpy(quad.src, item[FIELD_SRC], sizeof quad.src);
+            memcpy(quad.dest, item[FIELD_DEST], sizeof quad.dest);
+            quad.color = pack_overlay_color(item[FIELD_RGBA]);
+            quad.id = item_id;
+            sink->add_quad(quad);
+        }
+    }
+    depth--;
+    return true;
+}
+
+bool OverlaySceneParser::StartArray()
+{
+    scalar(0.0);
+    depth++;
+    if (depth == 1 && sink) {
+        sink->begin_scene();
+    }
+    if (depth == 3) {
+        field_index = 0;
+    }
+    if (depth == 2) {
+        // An array where an item should be; it is skipped
+        item_is_object = false;
+    }
+    return true;
+}
+
+bool OverlaySceneParser::EndArray(rapidjson::SizeType)
+{
+    if (depth == 3 && field <= FIELD_RGBA && field_index != 4) {
+        memset(item[field], 0, sizeof item[field]);
+    }
+    if (depth == 3) {
+        // Only the member's own array counts; later keys choose their own field
+        field = FIELD_NONE;
+    }
+    depth--;
+    if (depth == 0) {
+        finished = true;
+        if (sink) {
+            sink->end_scene(valid);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <rapidjson/reader.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Streaming parser for CameraOverlayScene, so scenes go from the socket payload
+// straight into vertex memory without an intermediate DOM.
+//
+// A scene is a JSON array of items shaped like
+//   { "id": n, "src": [x, y, w, h], "dest": [x, y, w, h], "rgba": [r, g, b, a] }
+// A missing or malformed vec4 reads as zeros, and unknown members are skipped,
+// the same as the DOM accessors in json-util.h. Items come out as OverlayQuads,
+// with the color already packed. The optional nonzero "id" names the item for
+// later CameraOverlayDelta messages (see overlay-scene-model.h).
+
+#define OVERLAY_NO_ID   0
+
+struct OverlayQuad {
+    double src[4];
+    double dest[4];
+    uint32_t color;     // RGBA8, red in the low byte
+    uint32_t id;
+};
+
+// Changes to a versioned scene. Applies only to a scene at version 'base', and
+// leaves it at 'version'. Removals happen first, then updates, then inserts.
+struct OverlaySceneDelta {
+    uint32_t base;
+    uint32_t version;
+    std::vector<uint32_t> removed;
+    std::vector<OverlayQuad> updated;
+    std::vector<OverlayQuad> inserted;
+};
+
+// Receives one scene at a time from the parser, on the parsing thread.
+class OverlaySceneSink {
+public:
+    virtual ~OverlaySceneSink() {}
+
+    virtual void begin_scene() = 0;
+    virtual void add_quad(OverlayQuad const &quad) = 0;
+    // 'complete' is false if the scene was malformed or too large; discard it
+    virtual void end_scene(bool complete) = 0;
+    // Make the last complete scene or delta visible, returning false if there was none.
+    // May be called later, or not at all if another scene replaces it first.
+    virtual bool publish_scene() = 0;
+
+    // Sinks that keep a versioned scene also take deltas. A full scene starts at
+    // the version given here after end_scene(), or 0.
+    virtual void set_scene_version(uint32_t) {}
+    virtual uint32_t get_scene_version() { return 0; }
+    // False if the delta doesn't apply to the current version
+    virtual bool apply_delta(OverlaySceneDelta const &) { return false; }
+};
+
+uint32_t pack_overlay_color(const double rgba[4]);
+
+// rapidjson SAX handler for a single scene array value.
+class OverlaySceneParser {
+public:
+    OverlaySceneParser(unsigned max_quads);
+
+    void start(OverlaySceneSink *sink);
+    bool is_finished() const { return finished; }
+    bool is_complete() const { return finished && valid; }
+    unsigned get_quad_count() const { return quad_count; }
+
+    bool Null()                 { return scalar(0.0); }
+    bool Bool(bool)             { return scalar(0.0); }
+    bool Int(int v)             { return scalar(v); }
+    bool Uint(unsigned v)       { return scalar(v); }
+    bool Int64(int64_t v)       { return scalar((double) v); }
+    bool Uint64(uint64_t v)     { return scalar((double) v); }
+    bool Double(double v)       { return scalar(v); }
+    bool RawNumber(const char*, rapidjson::SizeType, bool) { return scalar(0.0); }
+    bool String(const char*, rapidjson::SizeType, bool) { return scalar(0.0); }
+    bool Key(const char *str, rapidjson::SizeType len, bool);
+    bool StartObject();
+    bool EndObject(rapidjson::SizeType);
+    bool StartArray();
+    bool EndArray(rapidjson::SizeType);
+
+private:
+    enum { FIELD_SRC, FIELD_DEST, FIELD_RGBA, FIELD_ID, FIELD_NONE };
+
+    OverlaySceneSink *sink;
+    unsigned max_quads;
+    unsigned depth;
+    bool finished;
+    bool valid;
+    bool item_is_object;
+    unsigned quad_count;
+    unsigned field;
+    unsigned field_index;
+    double item[3][4];
+    uint32_t item_id;
+
+    bool scalar(double v);
+};
+
+// Sits between a rapidjson Reader and another handler, normally a Document being
+// populated. A "CameraOverlayScene" array goes to the scene parser instead, but only
+// where the controller sends one, as Stream[i].message.CameraOverlayScene, and only
+// if the filter was created with 'accept_scenes'. The other handler sees a
+// placeholder Bool in its place, true if the scene was complete. Scenes anywhere
+// else, or on a filter that doesn't accept them, reach the other handler unchanged.
+//
+// A "CameraOverlaySceneVersion" number in the same message as a complete scene is
+// given to the sink when that message ends, before any later scene can start, so
+// each scene gets its own version no matter where the member sits in the message.
+template <typename Handler>
+class OverlaySceneFilter {
+public:
+    OverlaySceneFilter(Handler &out, OverlaySceneParser &scene, OverlaySceneSink *sink, bool accept_scenes)
+        : out(out), scene(scene), sink(sink), accept_scenes(accept_scenes), key(KEY_OTHER), in_scene(false),
+          depth(0), stream_depth(0), message_depth(0), scene_depth(0), version_depth(0), version(0) {}
+
+    bool Null()                             { return in_scene ? scene.Null() : value() && out.Null(); }
+    bool Bool(bool b)                       { return in_scene ? scene.Bool(b) : value() && out.Bool(b); }
+    bool Int(int v)                         { return in_scene ? scene.Int(v) : number(v) && out.Int(v); }
+    bool Uint(unsigned v)                   { return in_scene ? scene.Uint(v) : number(v) && out.Uint(v); }
+    bool Int64(int64_t v)                   { return in_scene ? scene.Int64(v) : number((double) v) && out.Int64(v); }
+    bool Uint64(uint64_t v)                 { return in_scene ? scene.Uint64(v) : number((double) v) && out.Uint64(v); }
+    bool Double(double v)                   { return in_scene ? scene.Double(v) : number(v) && out.Double(v); }
+
+    bool RawNumber(const char *str, rapidjson::SizeType len, bool copy) {
+        return in_scene ? scene.RawNumber(str, len, copy) : value() && out.RawNumber(str, len, copy);
+    }
+
+    bool String(const char *str, rapidjson::SizeType len, bool copy) {
+        return in_scene ? scene.String(str, len, copy) : value() && out.String(str, len, copy);
+    }
+
+    bool Key(const char *str, rapidjson::SizeType len, bool copy) {
+        if (in_scene) {
+            return scene.Key(str, len, copy);
+        }
+        key = KEY_OTHER;
+        if (depth == 1 && len == 6 && !memcmp(str, "Stream", 6)) {
+            key = KEY_STREAM;
+        } else if (stream_depth && depth == stream_depth + 1 && len == 7 && !memcmp(str, "message", 7)) {
+            key = KEY_MESSAGE;
+        } else if (message_depth && depth == message_depth) {
+            if (accept_scenes && len == 18 && !memcmp(str, "CameraOverlayScene", 18)) {
+                key = KEY_SCENE;
+            } else if (len == 25 && !memcmp(str, "CameraOverlaySceneVersion", 25)) {
+                key = KEY_VERSION;
+            }
+        }
+        return out.Key(str, len, copy);
+    }
+
+    bool StartObject() {
+        if (in_scene) {
+            return scene.StartObject();
+        }
+        bool message = key == KEY_MESSAGE;
+        depth++;
+        if (message) {
+            message_depth = depth;
+        }
+        return value() && out.StartObject();
+    }
+
+    bool EndObject(rapidjson::SizeType count) {
+        if (in_scene) {
+            return scene.EndObject(count);
+        }
+        if (depth == message_depth) {
+            if (scene_depth == depth && version_depth == depth && sink) {
+                sink->set_scene_version(version);
+            }
+            message_depth = 0;
+            scene_depth = 0;
+            version_depth = 0;
+        }
+        depth--;
+        return value() && out.EndObject(count);
+    }
+
+    bool StartArray() {
+        if (in_scene) {
+            return scene.StartArray();
+        }
+        if (key == KEY_SCENE) {
+            key = KEY_OTHER;
+            in_scene = true;
+            scene.start(sink);
+            return scene.StartArray();
+        }
+        bool stream = key == KEY_STREAM;
+        depth++;
+        if (stream) {
+            stream_depth = depth;
+        }
+        return value() && out.StartArray();
+    }
+
+    bool EndArray(rapidjson::SizeType count) {
+        if (!in_scene) {
+            if (depth == stream_depth) {
+                stream_depth = 0;
+            }
+            depth--;
+            return value() && out.EndArray(count);
+        }
+        if (!scene.EndArray(count)) {
+            return false;
+        }
+        if (scene.is_finished()) {
+            in_scene = false;
+            if (scene.is_complete()) {
+                scene_depth = depth;
+            }
+            return out.Bool(scene.is_complete());
+        }
+        return true;
+    }
+
+private:
+    // What the value after the last key is, where that matters
+    enum KeyKind { KEY_OTHER, KEY_STREAM, KEY_MESSAGE, KEY_SCENE, KEY_VERSION };
+
+    Handler &out;
+    OverlaySceneParser &scene;
+    OverlaySceneSink *sink;
+    bool accept_scenes;
+    KeyKind key;
+    bool in_scene;
+    unsigned depth;             // Containers open outside of scenes
+    unsigned stream_depth;      // The top-level "Stream" array, while open
+    unsigned message_depth;     // A stream entry's "message" object, while open
+    unsigned scene_depth;       // Set with message_depth once it holds a complete scene
+    unsigned version_depth;     // Set with message_depth once it holds 'version'
+    uint32_t version;
+
+    bool value() {
+        key = KEY_OTHER;
+        return true;
+    }
+
+    bool number(double v) {
+        if (key == KEY_VERSION && v >= 0.0 && v <= 4294967295.0) {
+            version = (uint32_t) v;
+            version_depth = depth;
+        }
+        return value();
+    }
+};
@@ -0,0 +1,179 @@
+#include "pipeline-stats.h"
+#include "bot-connector.h"
+#include "image-grabber.h"
+#include "flyer-vision-tracker.h"
+#include "flyer-vision-detector.h"
+#include "task-pool.h"
+#include <util/platform.h>
+#include <stdio.h>
+
+using namespace rapidjson;
+
+static const char *grabber_stage_names[ImageGrabber::num_stages] = {
+    "render",
+    "readback",
+    "convert_wait",
+    "convert",
+    "consume_wait",
+};
+
+PipelineStats::PipelineStats(ImageGrabber &grabber_tracker, ImageGrabber &grabber_detector,
+    FlyerVisionTracker &tracker, FlyerVisionDetector &detector, BotConnector &bot)
+    : previous_nsec(os_gettime_ns())
+{
+    // Everything here outlives this object; the readers hold plain pointers
+    BotConnector *b = &bot;
+    FlyerVisionTracker *t = &tracker;
+    FlyerVisionDetector *d = &detector;
+
+    add_grabber("tracker", grabber_tracker);
+    add_histogram("tracker.update", [t] () { return t->get_update_latency(); });
+
+    add_grabber("detector", grabber_detector);
+    add_histogram("detector.inference", [d] () { return d->get_inference_latency(); });
+
+    add_histogram("pool.wait", [] () { return TaskPool::get().get_wait_latency(); }, true);
+    add_counter("pool.executed", [] () { return TaskPool::get().get_stats().executed; }, true);
+    add_counter("pool.stolen", [] () { return TaskPool::get().get_stats().stolen; }, true);
+
+    add_histogram("link.serialize", [b] () { return b->get_serialize_latency(); });
+    add_histogram("link.control_queue", [b] () { return b->get_outbound_latency(MessageLane::Control); });
+    add_histogram("link.bulk_queue", [b] () { return b->get_outbound_latency(MessageLane::Bulk); });
+    add_histogram("link.enqueue", [b] () { return b->get_enqueue_latency(); });
+    add_counter("link.frames", [b] () { return b->get_outbound_stats().frames; });
+    add_counter("link.dropped", [b] () { return b->get_outbound_stats().dropped; });
+    add_counter("link.replaced", [b] () { return b->get_outbound_stats().replaced; });
+
+    for (unsigned i = 0; i < OutboundQueue::num_kinds; i++) {
+        std::string kind = OutboundQueue::kind_name((MessageKind) i);
+        add_counter("link.sent." + kind, [b, i] () { return b->get_outbound_stats().sent_by_kind[i]; });
+        add_counter("link.bytes." + kind, [b, i] () { return b->get_outbound_stats().bytes_by_kind[i]; });
+    }
+
+    add_counter("inbound.messages", [b] () { return b->get_inbound_stats().messages; });
+    add_counter("inbound.bytes", [b] () { return b->get_inbound_stats().bytes; });
+}
+
+void PipelineStats::add_histogram(std::string const &name, std::function<LatencyHistogram::Snapshot()> read, bool shared)
+{
+    Histogram h;
+    h.name = name;
+    h.read = read;
+    h.previous = read();
+    h.shared = shared;
+    histograms.push_back(h);
+}
+
+void PipelineStats::add_counter(std::string const &name, std::function<uint64_t()> read, bool shared)
+{
+    Counter c;
+    c.name = name;
+    c.read = read;
+    c.previous = read();
+    c.shared = shared;
+    counters.push_back(c);
+}
+
+void PipelineStats::add_grabber(std::string const &prefix, ImageGrabber &grabber)
+{
+    ImageGrabber *g = &grabber;
+    for (unsigned i = 0; i < ImageGrabber::num_stages; i++) {
+        add_histogram(prefix + "." + grabber_stage_names[i],
+            [g, i] () { return g->get_latency((ImageGrabber::Stage) i); });
+    }
+    add_counter(prefix + ".captured", [g] () { return g->get_stats().captured; });
+    add_counter(prefix + ".consumed", [g] () { return g->get_stats().consumed; });
+    add_counter(prefix + ".skipped", [g] () { return g->get_stats().skipped; });
+    add_counter(prefix + ".dropped", [g] () { return g->get_stats().dropped; });
+}
+
+static MessageValue latency_summary(LatencyHistogram::Snapshot const &s, MessageAllocator &alloc)
+{
+    MessageValue obj;
+    obj.SetObject();
+    obj.AddMember("count", s.count, alloc);
+    obj.AddMember("mean_ms", s.mean() / 1e6, alloc);
+    obj.AddMember("p50_ms", s.percentile(0.5) / 1e6, alloc);
+    obj.AddMember("p90_ms", s.percentile(0.9) / 1e6, alloc);
+    obj.AddMember("p99_ms", s.percentile(0.99) / 1e6, alloc);
+    obj.AddMember("max_ms", s.max / 1e6, alloc);
+    return obj;
+}
+
+void PipelineStats::encode_interval(MessageValue &obj, MessageAllocator &alloc)
+{
+    uint64_t now = os_gettime_ns();
+
+    MessageValue latency, pool_latency;
+    latency.SetObject();
+    pool_latency.SetObject();
+    for (Histogram &h : histograms) {
+        LatencyHistogram::Snapshot total = h.read();
+        LatencyHistogram::Snapshot interval = total.since(h.previous);
+        h.previous = total;
+        if (interval.count) {
+            MessageValue name(StringRef(h.name.c_str(), (SizeType) h.name.size()));
+            (h.shared ? pool_latency : latency).AddMember(name, latency_summary(interval, alloc), alloc);
+        }
+    }
+
+    MessageValue counts, pool_counts;
+    counts.SetObject();
+    pool_counts.SetObject();
+    for (Counter &c : counters) {
+        uint64_t total = c.read();
+        MessageValue name(StringRef(c.name.c_str(), (SizeType) c.name.size()));
+        (c.shared ? pool_counts : counts).AddMember(name, total - c.previous, alloc);
+        c.previous = total;
+    }
+
+    TaskPool::Stats stats = TaskPool::get().get_stats();
+
+    MessageValue pool;
+    pool.SetObject();
+    pool.AddMember("threads", stats.threads, alloc);
+    pool.AddMember("queued", stats.queued, alloc);
+    pool.AddMember("latency", pool_latency, alloc);
+    pool.AddMember("counters", pool_counts, alloc);
+
+    obj.SetObject();
+    obj.AddMember("interval_sec", (now - previous_nsec) / 1e9, alloc);
+    obj.AddMember("latency", latency, alloc);
+    obj.AddMember("counters", counts, alloc);
+    obj.AddMember("pool", pool, alloc);
+    previous_nsec = now;
+}
+
+static void format_histogram(std::string &text, std::string const &name, LatencyHistogram::Snapshot const &s)
+{
+    char line[256];
+    snprintf(line, sizeof line, "%-26s n=%-9llu mean %.2f  p50 %.2f  p99 %.2f  max %.2f ms\n",
+        name.c_str(), (unsigned long long) s.count, s.mean() / 1e6,
+        s.percentile(0.5) / 1e6, s.percentile(0.99) / 1e6, s.max / 1e6);
+    text += line;
+}
+
+static void format_counter(std::string &text, std::string const &name, uint64_t value)
+{
+    char line[256];
+    snprintf(line, sizeof line, "%-26s %llu\n", name.c_str(), (unsigned long long) value);
+    text += line;
+}
+
+std::string PipelineStats::format_totals()
+{
+    std::string text;
+    std::string pool_text;
+
+    for (Histogram const &h : histograms) {
+        format_histogram(h.shared ? pool_text : text, h.name, h.read());
+    }
+    for (Counter const &c : counters) {
+        format_counter(c.shared ? pool_text : text, c.name, c.read());
+    }
+
+    if (!pool_text.empty()) {
+        text += "\nShared by all filters:\n" + pool_text;
+    }
+    return text;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "message-pool.h"
+#include "latency-histogram.h"
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class BotConnector;
+class ImageGrabber;
+class FlyerVisionTracker;
+class FlyerVisionDetector;
+
+// Names the latency histograms and counters kept along the vision pipeline, from
+// frame capture through to the websocket, and reports them together. Histogram
+// names are "<part>.<stage>", e.g. "tracker.convert" or "link.enqueue".
+//
+// encode_interval() covers what happened since its previous call, for the periodic
+// CameraPipelineStats message. format_totals() covers everything since startup, for
+// the filter's properties. Each of the two may be used from one thread.
+//
+// The task pool is shared by every filter, so its figures are the same in every
+// filter's report. They are kept apart, under "pool", so nobody adds them up.
+
+class PipelineStats {
+public:
+    PipelineStats(ImageGrabber &grabber_tracker, ImageGrabber &grabber_detector,
+        FlyerVisionTracker &tracker, FlyerVisionDetector &detector, BotConnector &bot);
+
+    void encode_interval(MessageValue &obj, MessageAllocator &alloc);
+    std::string format_totals();
+
+private:
+    struct Histogram {
+        std::string name;
+        std::function<LatencyHistogram::Snapshot()> read;
+        LatencyHistogram::Snapshot previous;
+        bool shared;            // Same for every filter
+    };
+
+    struct Counter {
+        std::string name;
+        std::function<uint64_t()> read;
+        uint64_t previous;
+        bool shared;
+    };
+
+    std::vector<Histogram> histograms;
+    std::vector<Counter> counters;
+    uint64_t previous_nsec;
+
+    void add_histogram(std::string const &name, std::function<LatencyHistogram::Snapshot()> read, bool shared = false);
+    void add_counter(std::string const &name, std::function<uint64_t()> read, bool shared = false);
+    void add_grabber(std::string const &prefix, ImageGrabber &grabber);
+};
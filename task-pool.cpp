@@ -0,0 +1,376 @@
+#include "task-pool.h"
+#include <obs-module.h>
+#include <util/platform.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define LOG_PREFIX          "TaskPool: "
+
+// Niceness for low priority workers where there is no thread priority API
+#define LOW_PRIORITY_NICE   5
+
+thread_local TaskPool::Crew *TaskPool::current_crew = 0;
+thread_local unsigned TaskPool::current_worker = 0;
+
+TaskPool &TaskPool::get()
+{
+    static TaskPool pool;
+    return pool;
+}
+
+TaskPool::TaskPool()
+    : pending(0),
+      next_worker(0),
+      executed(0),
+      stolen(0)
+{
+    settings.max_threads = 0;
+    settings.pin_threads = false;
+    settings.low_priority = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    start_crew();
+}
+
+TaskPool::~TaskPool()
+{
+    shutdown();
+}
+
+void TaskPool::shutdown()
+{
+    std::lock_guard<std::mutex> configure_lock(configure_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire_crew();
+    }
+    wake.notify_all();
+    join_retired(true);
+
+    // Nothing will run these now; cancelling lets their owners know
+    std::vector<Task> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        abandoned.swap(parked);
+        pending -= abandoned.size();
+    }
+    for (Task &task : abandoned) {
+        if (task.cancel) {
+            task.cancel();
+        }
+    }
+}
+
+void TaskPool::configure(Settings const &new_settings)
+{
+    std::lock_guard<std::mutex> configure_lock(configure_mutex);
+    bool running;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = crew != nullptr;
+    }
+    if (running &&
+        new_settings.max_threads == settings.max_threads &&
+        new_settings.pin_threads == settings.pin_threads &&
+        new_settings.low_priority == settings.low_priority) {
+        return;
+    }
+
+    settings = new_settings;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire_crew();
+        start_crew();
+    }
+    wake.notify_all();
+
+    // Never waits here; workers still busy from earlier changes are joined later
+    join_retired(false);
+}
+
+void TaskPool::start_crew()
+{
+    // Called with 'mutex' held
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    unsigned count = settings.max_threads ? settings.max_threads : hardware / 2;
+    count = std::max(1u, std::min(count, hardware));
+
+    std::shared_ptr<Crew> new_crew(new Crew());
+    new_crew->owner = this;
+    new_crew->settings = settings;
+    for (unsigned i = 0; i < count; i++) {
+        new_crew->workers.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < parked.size(); i++) {
+        new_crew->workers[i % count]->tasks.push_back(std::move(parked[i]));
+    }
+    parked.clear();
+    next_worker = 0;
+
+    Crew *c = new_crew.get();
+    for (unsigned i = 0; i < count; i++) {
+        c->workers[i]->thread = std::thread([=] () { worker_func(c, i); });
+    }
+    crew = new_crew;
+
+    blog(LOG_INFO, LOG_PREFIX "%u workers%s%s", count,
+        settings.pin_threads ? ", pinned" : "",
+        settings.low_priority ? ", low priority" : "");
+}
+
+void TaskPool::retire_crew()
+{
+    // Called with 'mutex' held. Workers finish the task in hand and exit; anything
+    // still queued is parked for the next crew.
+    if (!crew) {
+        return;
+    }
+    crew->retired = true;
+    for (auto &worker : crew->workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        for (auto &task : worker->tasks) {
+            parked.push_back(std::move(task));
+        }
+        worker->tasks.clear();
+    }
+    retired_crews.push_back(std::move(crew));
+    crew.reset();
+}
+
+void TaskPool::join_retired(bool wait)
+{
+    std::vector<std::shared_ptr<Crew>> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto i = retired_crews.begin(); i != retired_crews.end(); ) {
+            bool exited = std::all_of((*i)->workers.begin(), (*i)->workers.end(),
+                [] (std::unique_ptr<Worker> const &worker) { return worker->exited.load(); });
+            if (wait || exited) {
+                done.push_back(std::move(*i));
+                i = retired_crews.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+    for (auto &c : done) {
+        for (auto &worker : c->workers) {
+            worker->thread.join();
+        }
+    }
+}
+
+void TaskPool::submit(std::function<void()> fn, std::function<void()> cancel)
+{
+    Task task = { std::move(fn), std::move(cancel), os_gettime_ns() };
+
+    // From a worker, onto its own deque, unless its crew is being replaced
+    bool queued = false;
+    if (current_crew && current_crew->owner == this) {
+        Worker &worker = *current_crew->workers[current_worker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!current_crew->retired.load()) {
+            worker.tasks.push_back(std::move(task));
+            pending++;
+            queued = true;
+        }
+    }
+
+    if (!queued) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!crew) {
+            // Shut down
+            lock.unlock();
+            if (task.cancel) {
+                task.cancel();
+            }
+            return;
+        }
+        Worker &worker = *crew->workers[next_worker++ % crew->workers.size()];
+        std::lock_guard<std::mutex> worker_lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+        pending++;
+    }
+
+    // Taking the lock orders this against a worker checking 'pending' before it sleeps
+    { std::lock_guard<std::mutex> lock(mutex); }
+    wake.notify_one();
+}
+
+bool TaskPool::take(Crew &c, unsigned index, Task &task)
+{
+    {
+        Worker &own = *c.workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending--;
+            return true;
+        }
+    }
+
+    for (size_t n = 1; n < c.workers.size(); n++) {
+        Worker &victim = *c.workers[(index + n) % c.workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending--;
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::worker_func(Crew *c, unsigned index)
+{
+    current_crew = c;
+    current_worker = index;
+    apply_thread_settings(c->settings, index);
+
+    Task task;
+    while (!c->retired.load()) {
+        if (take(*c, index, task)) {
+            wait_latency.record(os_gettime_ns() - task.queued_nsec);
+            task.fn();
+            task.fn = nullptr;
+            task.cancel = nullptr;
+            executed++;
+            continue;
+        }
+
+        // 'retired' is set under this lock too, so a retired worker never sleeps here
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [=] { return c->retired.load() || pending.load() > 0; });
+    }
+
+    current_crew = 0;
+    c->workers[index]->exited = true;
+}
+
+void TaskPool::apply_thread_settings(Settings const &settings, unsigned index)
+{
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    // Pinned workers fill cores from the last one down, away from OBS's own early threads
+    unsigned core = hardware - 1 - (index % hardware);
+
+#if defined(_WIN32)
+    if (settings.low_priority) {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    }
+    if (settings.pin_threads && core < 64) {
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << core);
+    }
+#elif defined(__linux__)
+    if (settings.low_priority) {
+        // Linux applies niceness per thread
+        setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), LOW_PRIORITY_NICE);
+    }
+    if (settings.pin_threads) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+    }
+#else
+    (void) core;
+#endif
+}
+
+TaskPool::Stats TaskPool::get_stats()
+{
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.threads = crew ? (unsigned) crew->workers.size() : 0;
+    }
+    stats.queued = pending.load();
+    stats.executed = executed.load();
+    stats.stolen = stolen.load();
+    return stats;
+}
+
+LatencyHistogram::Snapshot TaskPool::get_wait_latency()
+{
+    return wait_latency.snapshot();
+}
+
+SerialTask::SerialTask(std::function<void()> fn)
+    : fn(fn),
+      state(IDLE),
+      stopped(false)
+{}
+
+SerialTask::~SerialTask()
+{
+    stop();
+}
+
+void SerialTask::trigger()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopped) {
+            return;
+        }
+        switch (state) {
+        case IDLE:
+            state = QUEUED;
+            break;
+        case RUNNING:
+            state = RUNNING_TRIGGERED;
+            return;
+        default:
+            return;
+        }
+    }
+    // Outside the lock; the pool may cancel the call straight away
+    TaskPool::get().submit([this] () { run(); }, [this] () { cancel(); });
+}
+
+void SerialTask::stop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    stopped = true;
+    idle.wait(lock, [=] { return state == IDLE; });
+}
+
+void SerialTask::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!stopped) {
+        state = RUNNING;
+        lock.unlock();
+        fn();
+        lock.lock();
+
+        // Requeued rather than looped, so a busy task can't hold on to its worker
+        if (state == RUNNING_TRIGGERED && !stopped) {
+            state = QUEUED;
+            lock.unlock();
+            TaskPool::get().submit([this] () { run(); }, [this] () { cancel(); });
+            return;
+        }
+    }
+    state = IDLE;
+    idle.notify_all();
+}
+
+void SerialTask::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    state = IDLE;
+    idle.notify_all();
+}
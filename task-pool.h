@@ -0,0 +1,142 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "latency-histogram.h"
+
+// Process-wide worker pool for vision work: frame conversion, detection, tracking,
+// and the result serialization that follows them. All filter instances share it,
+// so adding cameras adds tasks rather than threads, and the total stays within a
+// core budget. Workers can run below normal priority and be pinned to cores, so
+// OBS's encoder and render threads keep first claim on the CPU.
+//
+// Each worker has its own deque. A task submitted from a worker goes on that
+// worker's deque and is taken newest first; tasks from other threads are dealt
+// round robin. A worker with nothing left steals the oldest task from another.
+
+class TaskPool {
+public:
+    struct Settings {
+        unsigned max_threads;   // 0 leaves half the hardware threads to OBS
+        bool pin_threads;       // Bind each worker to its own core
+        bool low_priority;
+    };
+
+    struct Stats {
+        unsigned threads;
+        uint64_t queued;
+        uint64_t executed;
+        uint64_t stolen;
+    };
+
+    static TaskPool &get();
+
+    TaskPool();
+    ~TaskPool();
+
+    // Changes take effect without waiting on running tasks: a new set of workers
+    // starts at once and takes over the queue, and the old ones leave once the task
+    // in hand is done.
+    void configure(Settings const &settings);
+    // Joins the workers; call at module unload, once no filters are left. Tasks
+    // still queued are cancelled, as are any submitted afterwards.
+    void shutdown();
+    // 'cancel', if given, is called in place of a task that will never run
+    void submit(std::function<void()> task, std::function<void()> cancel = nullptr);
+    Stats get_stats();
+    // Time from submit() until a worker picks the task up
+    LatencyHistogram::Snapshot get_wait_latency();
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        std::function<void()> cancel;
+        uint64_t queued_nsec;
+    };
+
+    struct Worker {
+        Worker() : exited(false) {}
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        std::atomic<bool> exited;
+    };
+
+    // Workers started together with one set of settings. They only steal from each
+    // other, and are replaced as a whole when the settings change.
+    struct Crew {
+        Crew() : owner(0), retired(false) {}
+        TaskPool *owner;
+        Settings settings;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> retired;
+    };
+
+    // Which crew and worker the calling thread is, if any
+    static thread_local Crew *current_crew;
+    static thread_local unsigned current_worker;
+
+    std::mutex configure_mutex;
+    Settings settings;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::shared_ptr<Crew> crew;                         // None after shutdown
+    std::vector<std::shared_ptr<Crew>> retired_crews;   // Kept until their workers are joined
+    std::vector<Task> parked;                           // Between crews, and at shutdown
+    std::atomic<uint64_t> pending;
+    unsigned next_worker;
+
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> stolen;
+    LatencyHistogram wait_latency;
+
+    void start_crew();
+    void retire_crew();
+    void join_retired(bool wait);
+    bool take(Crew &crew, unsigned index, Task &task);
+    void worker_func(Crew *crew, unsigned index);
+    void apply_thread_settings(Settings const &settings, unsigned index);
+};
+
+// Runs one function on the pool, never more than one call at a time. Triggers that
+// arrive while a run is queued are merged, and one that arrives while it runs
+// queues one more run afterwards. Suits work that keeps state between runs and
+// only cares about the newest input, like a per-camera tracker.
+
+class SerialTask {
+public:
+    SerialTask(std::function<void()> fn);
+    ~SerialTask();
+
+    void trigger();
+
+    // Ignores later triggers and waits until no call is queued or running. A call
+    // still queued doesn't run the function once it's picked up, but stop() waits
+    // for that, or for the pool to cancel it at shutdown. Call it before destroying
+    // anything the function uses.
+    void stop();
+
+private:
+    enum State {
+        IDLE,
+        QUEUED,
+        RUNNING,
+        RUNNING_TRIGGERED,
+    };
+
+    std::function<void()> fn;
+    std::mutex mutex;
+    std::condition_variable idle;
+    State state;
+    bool stopped;
+
+    void run();
+    void cancel();
+};
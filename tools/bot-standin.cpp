@@ -0,0 +1,725 @@
+// Stand-in for the bot controller, for exercising BotConnector on one machine.
+//
+// Speaks the same protocol: HTTP discovery at /ws, an HMAC-SHA512 Auth challenge,
+// Subscription and ClientFeatures/ServerFeatures, Stream messages carrying overlay
+// scenes and deltas, tracked region resets and commands, and Command / Batch /
+// binary vision messages from the plugin. Faults can be injected on a schedule, and
+// throughput, vision latency and reconnect gaps are printed once a second.
+//
+// Point the filter's connection file at the one written by --connection-file.
+//
+// Usage: bot-standin [options]
+//   --port N               Listening port (8080)
+//   --key KEY              Auth key (standin)
+//   --connection-file PATH Write a connection.txt for this server
+//   --features LIST        Comma separated ServerFeatures to accept (BinaryVision,Batch,OverlayDelta)
+//   --no-deflate           Don't accept permessage-deflate
+//   --scene-rate HZ        CameraOverlayScene messages per second (10)
+//   --scene-quads N        Quads per scene (2000)
+//   --delta-rate HZ        CameraOverlayDelta messages per second, updating the readout glyphs (0)
+//   --binary-delta         Send deltas as binary frames
+//   --region-rate HZ       CameraInitTrackedRegion messages per second (0)
+//   --command-rate HZ      CameraOutputEnable commands per second, always disabling (0)
+//   --slow-read MS         Stop reading from each client for MS of every second (0)
+//   --drop-interval SEC    Close every connection this often (0, never)
+//   --auth-fail-rate P     Probability of rejecting a correct auth digest (0)
+//   --http-delay MS        Delay discovery responses (0)
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/server.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include "cryptopp/hmac.h"
+#include "cryptopp/sha.h"
+#include "cryptopp/base64.h"
+#include "cryptopp/filters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using websocketpp::connection_hdl;
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+static bool deflate_enabled = true;
+
+template <typename config>
+class StandinDeflate : public websocketpp::extensions::permessage_deflate::enabled<config> {
+public:
+    bool is_implemented() const {
+        return deflate_enabled;
+    }
+};
+
+struct StandinConfig : public websocketpp::config::asio {
+    typedef StandinConfig type;
+
+    struct permessage_deflate_config {};
+    typedef StandinDeflate<permessage_deflate_config> permessage_deflate_type;
+};
+
+typedef websocketpp::server<StandinConfig> server_t;
+typedef server_t::message_ptr message_ptr;
+
+// Binary vision layout, see vision-messages.h
+#define BINARY_BATCH                    0
+#define BINARY_CAMERA_REGION_TRACKING   1
+#define BINARY_CAMERA_OBJECT_DETECTION  2
+#define BINARY_TRACKING_FRAME_TIME      68
+#define BINARY_DETECTION_FRAME_TIME     20
+
+// Binary overlay delta layout, see overlay-scene-model.h
+#define BINARY_OVERLAY_DELTA            3
+#define BINARY_MESSAGE_VERSION          2
+
+struct Options {
+    unsigned port = 8080;
+    std::string key = "standin";
+    std::string connection_file;
+    std::set<std::string> features = { "BinaryVision", "Batch", "OverlayDelta" };
+    double scene_rate = 10.0;
+    unsigned scene_quads = 2000;
+    double delta_rate = 0.0;
+    bool binary_delta = false;
+    double region_rate = 0.0;
+    double command_rate = 0.0;
+    unsigned slow_read_msec = 0;
+    double drop_interval = 0.0;
+    double auth_fail_rate = 0.0;
+    unsigned http_delay_msec = 0;
+};
+
+struct Summary {
+    uint64_t count = 0;
+    double sum = 0, min = 0, max = 0;
+
+    void add(double v) {
+        min = count ? std::min(min, v) : v;
+        max = count ? std::max(max, v) : v;
+        sum += v;
+        count++;
+    }
+
+    void print(const char *name) {
+        if (count) {
+            printf("  %s %.1f/%.1f/%.1f ms", name, min, sum / count, max);
+        }
+    }
+};
+
+struct Counters {
+    uint64_t connections = 0, auth_ok = 0, auth_failed = 0, drops = 0;
+    uint64_t frames_in = 0, bytes_in = 0, messages_in = 0, binary_in = 0;
+    uint64_t tracking = 0, detection = 0, status = 0, other = 0;
+    uint64_t frames_out = 0, bytes_out = 0, scenes_out = 0, deltas_out = 0, resyncs = 0;
+    Summary vision_latency;     // frame_time to arrival here, once the plugin's clock is synced
+    Summary reconnect_gap;      // Last close to next authenticated connection
+};
+
+static double now_sec()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::string hmac_digest(std::string const &key, std::string const &challenge)
+{
+    using namespace CryptoPP;
+    HMAC<SHA512> hmac((const byte*) key.c_str(), key.size());
+    std::string digest;
+    StringSource s(challenge, true, new HashFilter(hmac, new Base64Encoder(new StringSink(digest), false)));
+    return digest;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_u32(std::string &out, uint32_t v)
+{
+    char b[4] = { (char) v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+    out.append(b, sizeof b);
+}
+
+static void put_f32(std::string &out, double v)
+{
+    float f = (float) v;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    put_u32(out, bits);
+}
+
+static double get_f64(const uint8_t *p)
+{
+    uint64_t bits = get_u32(p) | ((uint64_t) get_u32(p + 4) << 32);
+    double v;
+    memcpy(&v, &bits, sizeof v);
+    return v;
+}
+
+class Standin {
+public:
+    Standin(Options const &opts) : opts(opts), stats_timer(io), scene_timer(io), delta_timer(io),
+        region_timer(io), command_timer(io), fault_timer(io), drop_timer(io), rng(std::random_device()())
+    {
+        server.clear_access_channels(websocketpp::log::alevel::all);
+        server.init_asio(&io);
+        server.set_reuse_addr(true);
+        server.set_open_handler(bind(&Standin::on_open, this, ::_1));
+        server.set_close_handler(bind(&Standin::on_close, this, ::_1));
+        server.set_message_handler(bind(&Standin::on_message, this, ::_1, ::_2));
+        server.set_http_handler(bind(&Standin::on_http, this, ::_1));
+
+        for (unsigned i = 0; i < 8; i++) {
+            scenes.push_back(make_scene(i));
+        }
+    }
+
+    void run() {
+        server.listen(opts.port);
+        server.start_accept();
+        printf("Listening on port %u, scenes are %zu bytes\n", opts.port, scenes[0].size());
+
+        every(stats_timer, 1.0, [=] () { print_stats(); });
+        every(scene_timer, opts.scene_rate ? 1.0 / opts.scene_rate : 0, [=] () { send_scene(); });
+        every(delta_timer, opts.delta_rate ? 1.0 / opts.delta_rate : 0, [=] () { send_delta(); });
+        every(region_timer, opts.region_rate ? 1.0 / opts.region_rate : 0, [=] () { send_region(); });
+        every(command_timer, opts.command_rate ? 1.0 / opts.command_rate : 0, [=] () { send_command(); });
+        every(fault_timer, opts.slow_read_msec ? 1.0 : 0, [=] () { slow_reads(); });
+        every(drop_timer, opts.drop_interval, [=] () { drop_all(); });
+        io.run();
+    }
+
+private:
+    struct Client {
+        std::string challenge;
+        bool authenticated = false;
+        bool overlay_delta = false;
+        std::set<std::string> subscriptions;
+    };
+
+    Options opts;
+    asio::io_service io;
+    server_t server;
+    asio::steady_timer stats_timer, scene_timer, delta_timer, region_timer, command_timer, fault_timer, drop_timer;
+    std::map<connection_hdl, Client, std::owner_less<connection_hdl>> clients;
+    std::vector<std::string> scenes;
+    unsigned scene_index = 0;
+    uint32_t scene_version = 0;
+    unsigned delta_index = 0;
+    std::mt19937 rng;
+    Counters counters, totals;
+    double last_close = 0.0;
+
+    void every(asio::steady_timer &timer, double interval, std::function<void()> fn) {
+        if (interval <= 0.0) {
+            return;
+        }
+        timer.expires_from_now(std::chrono::microseconds((int64_t)(interval * 1e6)));
+        timer.async_wait([=, &timer] (const asio::error_code &ec) {
+            if (!ec) {
+                fn();
+                every(timer, interval, fn);
+            }
+        });
+    }
+
+    // Lines of text; the first few columns are a readout that changes with 'variant'
+    static const unsigned columns = 80;
+    static const unsigned readout_columns = 6;
+
+    void make_item(unsigned i, unsigned variant, double src[4], double dest[4], double rgba[4]) {
+        unsigned col = i % columns, row = i / columns;
+        unsigned glyph = col < readout_columns ? '0' + (variant * (col + 1) + row) % 10 : 32 + (i * 7 + row) % 95;
+        double s[4] = { (glyph % 16) / 16.0, (glyph / 16) / 16.0, 1 / 16.0, 1 / 16.0 };
+        double d[4] = { -0.98 + col * 0.0245, -0.95 + (row % 40) * 0.04375, 0.0245, 0.04375 };
+        double c[4] = { 0.9, 0.9, 0.9, 0.8 };
+        memcpy(src, s, sizeof s);
+        memcpy(dest, d, sizeof d);
+        memcpy(rgba, c, sizeof c);
+    }
+
+    void write_item(rapidjson::Writer<rapidjson::StringBuffer> &writer, unsigned i, unsigned variant) {
+        double src[4], dest[4], rgba[4];
+        make_item(i, variant, src, dest, rgba);
+
+        writer.StartObject();
+        writer.Key("id");
+        writer.Uint(i + 1);
+        const char *keys[] = { "src", "dest", "rgba" };
+        const double *values[] = { src, dest, rgba };
+        for (unsigned k = 0; k < 3; k++) {
+            writer.Key(keys[k]);
+            writer.StartArray();
+            for (unsigned j = 0; j < 4; j++) {
+                writer.Double(values[k][j]);
+            }
+            writer.EndArray();
+        }
+        writer.EndObject();
+    }
+
+    std::string make_scene(unsigned variant) {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+        writer.StartArray();
+        for (unsigned i = 0; i < opts.scene_quads; i++) {
+            write_item(writer, i, variant);
+        }
+        writer.EndArray();
+        return std::string(buffer.GetString(), buffer.GetSize());
+    }
+
+    void send_text(connection_hdl hdl, std::string const &text) {
+        websocketpp::lib::error_code ec;
+        server.send(hdl, text, websocketpp::frame::opcode::text, ec);
+        if (!ec) {
+            counters.frames_out++;
+            counters.bytes_out += text.size();
+        }
+    }
+
+    void stream(const char *type, std::string const &message_json, bool delta_only = false) {
+        char timestamp[32];
+        snprintf(timestamp, sizeof timestamp, "%.6f", now_sec());
+        std::string text = std::string("{\"Stream\":[{\"timestamp\":") + timestamp +
+            ",\"message\":" + message_json + "}]}";
+
+        for (auto &client : clients) {
+            if (client.second.authenticated && client.second.subscriptions.count(type) &&
+                (!delta_only || client.second.overlay_delta)) {
+                send_text(client.first, text);
+            }
+        }
+    }
+
+    void send_scene() {
+        char version[64];
+        snprintf(version, sizeof version, ",\"CameraOverlaySceneVersion\":%u}", ++scene_version);
+        stream("CameraOverlayScene", "{\"CameraOverlayScene\":" + scenes[scene_index++ % scenes.size()] + version);
+        counters.scenes_out++;
+    }
+
+    void send_delta() {
+        // Rewrites only the readout glyphs, a few percent of the scene
+        uint32_t base = scene_version++;
+        unsigned variant = ++delta_index;
+        std::vector<unsigned> items;
+        for (unsigned i = 0; i < opts.scene_quads; i++) {
+            if (i % columns < readout_columns) {
+                items.push_back(i);
+            }
+        }
+
+        if (!opts.binary_delta) {
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            writer.StartObject();
+            writer.Key("CameraOverlayDelta");
+            writer.StartObject();
+            writer.Key("base");
+            writer.Uint(base);
+            writer.Key("version");
+            writer.Uint(scene_version);
+            writer.Key("update");
+            writer.StartArray();
+            for (unsigned i : items) {
+                write_item(writer, i, variant);
+            }
+            writer.EndArray();
+            writer.EndObject();
+            writer.EndObject();
+            stream("CameraOverlayDelta", std::string(buffer.GetString(), buffer.GetSize()), true);
+            counters.deltas_out++;
+            return;
+        }
+
+        std::string frame;
+        frame += (char) BINARY_OVERLAY_DELTA;
+        frame += (char) BINARY_MESSAGE_VERSION;
+        frame.append(2, '\0');
+        put_u32(frame, base);
+        put_u32(frame, scene_version);
+        put_u32(frame, 0);
+        put_u32(frame, (uint32_t) items.size());
+        put_u32(frame, 0);
+        for (unsigned i : items) {
+            double src[4], dest[4], rgba[4];
+            make_item(i, variant, src, dest, rgba);
+            put_u32(frame, i + 1);
+            for (unsigned j = 0; j < 4; j++) {
+                put_f32(frame, src[j]);
+            }
+            for (unsigned j = 0; j < 4; j++) {
+                put_f32(frame, dest[j]);
+            }
+            for (unsigned j = 0; j < 4; j++) {
+                frame += (char)(uint8_t) std::max(0.0, std::min(255.0, rgba[j] * 255.0 + 0.5));
+            }
+        }
+
+        for (auto &client : clients) {
+            if (client.second.authenticated && client.second.overlay_delta &&
+                client.second.subscriptions.count("CameraOverlayDelta")) {
+                websocketpp::lib::error_code ec;
+                server.send(client.first, frame, websocketpp::frame::opcode::binary, ec);
+                if (!ec) {
+                    counters.frames_out++;
+                    counters.bytes_out += frame.size();
+                }
+            }
+        }
+        counters.deltas_out++;
+    }
+
+    void send_region() {
+        std::uniform_real_distribution<double> pos(-0.8, 0.4), size(0.05, 0.4);
+        char json[160];
+        snprintf(json, sizeof json, "{\"CameraInitTrackedRegion\":[%f,%f,%f,%f]}",
+            pos(rng), pos(rng) * 0.5, size(rng), size(rng));
+        stream("CameraInitTrackedRegion", json);
+    }
+
+    void send_command() {
+        // Only ever disables, so pointing this at a real OBS can't start a stream
+        stream("Command", "{\"Command\":{\"CameraOutputEnable\":[\"LocalRecording\",false]}}");
+    }
+
+    void slow_reads() {
+        for (auto &client : clients) {
+            websocketpp::lib::error_code ec;
+            server_t::connection_ptr con = server.get_con_from_hdl(client.first, ec);
+            if (ec) {
+                continue;
+            }
+            con->pause_reading();
+            auto timer = std::make_shared<asio::steady_timer>(io);
+            timer->expires_from_now(std::chrono::milliseconds(opts.slow_read_msec));
+            timer->async_wait([con, timer] (const asio::error_code &) {
+                con->resume_reading();
+            });
+        }
+    }
+
+    void drop_all() {
+        for (auto &client : clients) {
+            websocketpp::lib::error_code ec;
+            server.close(client.first, websocketpp::close::status::going_away, "Injected drop", ec);
+            counters.drops++;
+        }
+    }
+
+    void on_http(connection_hdl hdl) {
+        server_t::connection_ptr con = server.get_con_from_hdl(hdl);
+        if (con->get_resource() != "/ws") {
+            con->set_status(websocketpp::http::status_code::not_found);
+            return;
+        }
+
+        char body[128];
+        snprintf(body, sizeof body, "{\"uri\":\"ws://127.0.0.1:%u/\"}", opts.port);
+        con->set_status(websocketpp::http::status_code::ok);
+        con->append_header("Content-Type", "application/json");
+        con->set_body(body);
+
+        if (opts.http_delay_msec) {
+            con->defer_http_response();
+            auto timer = std::make_shared<asio::steady_timer>(io);
+            timer->expires_from_now(std::chrono::milliseconds(opts.http_delay_msec));
+            timer->async_wait([con, timer] (const asio::error_code &) {
+                con->send_http_response();
+            });
+        }
+    }
+
+    void on_open(connection_hdl hdl) {
+        // Shows what each connection actually negotiated, e.g. after changing the filter's compression settings
+        server_t::connection_ptr con = server.get_con_from_hdl(hdl);
+        std::string offered = con->get_request_header("Sec-WebSocket-Extensions");
+        std::string accepted = con->get_response_header("Sec-WebSocket-Extensions");
+        printf("Client connected, extensions offered: %s, accepted: %s\n",
+            offered.empty() ? "none" : offered.c_str(), accepted.empty() ? "none" : accepted.c_str());
+
+        Client &client = clients[hdl];
+        std::uniform_int_distribution<uint32_t> word;
+        char challenge[64];
+        snprintf(challenge, sizeof challenge, "%08x%08x%08x%08x", word(rng), word(rng), word(rng), word(rng));
+        client.challenge = challenge;
+        counters.connections++;
+        send_text(hdl, std::string("{\"Auth\":{\"challenge\":\"") + challenge + "\"}}");
+    }
+
+    void on_close(connection_hdl hdl) {
+        clients.erase(hdl);
+        last_close = now_sec();
+    }
+
+    void on_message(connection_hdl hdl, message_ptr msg) {
+        auto it = clients.find(hdl);
+        if (it == clients.end()) {
+            return;
+        }
+        Client &client = it->second;
+        std::string const &payload = msg->get_payload();
+        counters.frames_in++;
+        counters.bytes_in += payload.size();
+
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            on_binary((const uint8_t*) payload.data(), payload.size());
+            return;
+        }
+
+        rapidjson::Document doc;
+        doc.Parse(payload.c_str());
+        if (!doc.IsObject()) {
+            return;
+        }
+        if (doc.HasMember("Batch") && doc["Batch"].IsArray()) {
+            for (auto &item : doc["Batch"].GetArray()) {
+                on_json(hdl, client, item);
+            }
+        } else {
+            on_json(hdl, client, doc);
+        }
+    }
+
+    void on_json(connection_hdl hdl, Client &client, rapidjson::Value const &msg) {
+        if (!msg.IsObject()) {
+            return;
+        }
+        counters.messages_in++;
+
+        if (msg.HasMember("Auth") && msg["Auth"].IsObject() && msg["Auth"].HasMember("digest")) {
+            std::uniform_real_distribution<double> chance(0.0, 1.0);
+            bool ok = msg["Auth"]["digest"].IsString() &&
+                hmac_digest(opts.key, client.challenge) == msg["Auth"]["digest"].GetString() &&
+                chance(rng) >= opts.auth_fail_rate;
+            client.authenticated = ok;
+            if (ok) {
+                counters.auth_ok++;
+                if (last_close > 0.0) {
+                    counters.reconnect_gap.add((now_sec() - last_close) * 1e3);
+                    last_close = 0.0;
+                }
+            } else {
+                counters.auth_failed++;
+            }
+            send_text(hdl, ok ? "{\"AuthStatus\":true}" : "{\"AuthStatus\":false}");
+            return;
+        }
+
+        if (msg.HasMember("Subscription") && msg["Subscription"].IsArray()) {
+            client.subscriptions.clear();
+            for (auto &name : msg["Subscription"].GetArray()) {
+                if (name.IsString()) {
+                    client.subscriptions.insert(name.GetString());
+                }
+            }
+            return;
+        }
+
+        if (msg.HasMember("ClientFeatures") && msg["ClientFeatures"].IsArray()) {
+            std::string reply = "{\"ServerFeatures\":[";
+            bool first = true;
+            for (auto &name : msg["ClientFeatures"].GetArray()) {
+                if (name.IsString() && opts.features.count(name.GetString())) {
+                    reply += std::string(first ? "\"" : ",\"") + name.GetString() + "\"";
+                    first = false;
+                    if (!strcmp(name.GetString(), "OverlayDelta")) {
+                        client.overlay_delta = true;
+                    }
+                }
+            }
+            send_text(hdl, reply + "]}");
+            return;
+        }
+
+        if (!client.authenticated) {
+            return;
+        }
+
+        if (msg.HasMember("CameraOverlayResync")) {
+            // A full scene goes to every client and restarts their versions, which is fine here
+            counters.resyncs++;
+            send_scene();
+            return;
+        }
+
+        if (msg.HasMember("Command") && msg["Command"].IsObject()) {
+            rapidjson::Value const &cmd = msg["Command"];
+            rapidjson::Value const *body = NULL;
+            if (cmd.HasMember("CameraRegionTracking")) {
+                counters.tracking++;
+                body = &cmd["CameraRegionTracking"];
+            } else if (cmd.HasMember("CameraObjectDetection")) {
+                counters.detection++;
+                body = &cmd["CameraObjectDetection"];
+            } else if (cmd.HasMember("CameraOutputStatus") || cmd.HasMember("CameraPipelineStats")) {
+                counters.status++;
+            } else {
+                counters.other++;
+            }
+            if (body && body->IsObject() && body->HasMember("frame_time") && (*body)["frame_time"].IsNumber()) {
+                add_vision_latency((*body)["frame_time"].GetDouble());
+            }
+        }
+    }
+
+    void on_binary(const uint8_t *data, size_t size) {
+        if (size < 4) {
+            return;
+        }
+        if (data[0] != BINARY_BATCH) {
+            on_binary_record(data, size);
+            return;
+        }
+
+        unsigned count = data[2] | (data[3] << 8);
+        size_t offset = 4;
+        for (unsigned i = 0; i < count && offset + 4 <= size; i++) {
+            uint32_t len = get_u32(data + offset);
+            offset += 4;
+            if (offset + len > size) {
+                break;
+            }
+            on_binary_record(data + offset, len);
+            offset += len;
+        }
+    }
+
+    void on_binary_record(const uint8_t *data, size_t size) {
+        counters.messages_in++;
+        counters.binary_in++;
+        if (size < 4) {
+            return;
+        }
+        if (data[0] == BINARY_CAMERA_REGION_TRACKING) {
+            counters.tracking++;
+            if (size >= BINARY_TRACKING_FRAME_TIME + 8) {
+                add_vision_latency(get_f64(data + BINARY_TRACKING_FRAME_TIME));
+            }
+        } else if (data[0] == BINARY_CAMERA_OBJECT_DETECTION) {
+            counters.detection++;
+            if (size >= BINARY_DETECTION_FRAME_TIME + 8) {
+                add_vision_latency(get_f64(data + BINARY_DETECTION_FRAME_TIME));
+            }
+        } else {
+            counters.other++;
+        }
+    }
+
+    void add_vision_latency(double frame_time) {
+        if (frame_time > 0.0) {
+            counters.vision_latency.add((now_sec() - frame_time) * 1e3);
+        }
+    }
+
+    void print_stats() {
+        Counters &c = counters;
+        printf("clients %zu  conn +%llu auth %llu/%llu fail drops %llu  in %llu frames %llu msgs (%llu bin) %.1f KB"
+            "  track %llu detect %llu status %llu  out %llu frames %llu scenes %llu deltas %llu resyncs %.1f KB",
+            clients.size(), (unsigned long long) c.connections, (unsigned long long) c.auth_ok,
+            (unsigned long long) c.auth_failed, (unsigned long long) c.drops,
+            (unsigned long long) c.frames_in, (unsigned long long) c.messages_in,
+            (unsigned long long) c.binary_in, c.bytes_in / 1024.0,
+            (unsigned long long) c.tracking, (unsigned long long) c.detection, (unsigned long long) c.status,
+            (unsigned long long) c.frames_out, (unsigned long long) c.scenes_out,
+            (unsigned long long) c.deltas_out, (unsigned long long) c.resyncs, c.bytes_out / 1024.0);
+        c.vision_latency.print("latency");
+        c.reconnect_gap.print("reconnect");
+        printf("\n");
+        fflush(stdout);
+        counters = Counters();
+    }
+};
+
+static std::set<std::string> split_list(const char *list)
+{
+    std::set<std::string> result;
+    std::string item;
+    for (const char *p = list;; p++) {
+        if (*p == ',' || !*p) {
+            if (!item.empty()) {
+                result.insert(item);
+            }
+            item.clear();
+            if (!*p) {
+                break;
+            }
+        } else {
+            item += *p;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--no-deflate") {
+            deflate_enabled = false;
+            continue;
+        }
+        if (arg == "--binary-delta") {
+            opts.binary_delta = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        const char *value = argv[++i];
+
+        if (arg == "--port") opts.port = atoi(value);
+        else if (arg == "--key") opts.key = value;
+        else if (arg == "--connection-file") opts.connection_file = value;
+        else if (arg == "--features") opts.features = split_list(value);
+        else if (arg == "--scene-rate") opts.scene_rate = atof(value);
+        else if (arg == "--scene-quads") opts.scene_quads = atoi(value);
+        else if (arg == "--delta-rate") opts.delta_rate = atof(value);
+        else if (arg == "--region-rate") opts.region_rate = atof(value);
+        else if (arg == "--command-rate") opts.command_rate = atof(value);
+        else if (arg == "--slow-read") opts.slow_read_msec = atoi(value);
+        else if (arg == "--drop-interval") opts.drop_interval = atof(value);
+        else if (arg == "--auth-fail-rate") opts.auth_fail_rate = atof(value);
+        else if (arg == "--http-delay") opts.http_delay_msec = atoi(value);
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (!opts.connection_file.empty()) {
+        FILE *f = fopen(opts.connection_file.c_str(), "w");
+        if (!f) {
+            perror(opts.connection_file.c_str());
+            return 1;
+        }
+        fprintf(f, "http://127.0.0.1:%u/#/?k=%s\n", opts.port, opts.key.c_str());
+        fclose(f);
+    }
+
+    try {
+        Standin standin(opts);
+        standin.run();
+    } catch (websocketpp::exception const &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
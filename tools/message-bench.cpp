@@ -0,0 +1,77 @@
+// Serialize cost and size of vision messages, JSON versus binary encoding.
+//
+// Usage: message-bench [iterations] [objects per detection]
+
+#include "vision-messages.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+static const char *labels[] = { "person", "bicycle", "car", "dog", "kite" };
+
+template <typename Result>
+static void bench(const char *name, Result const &result, unsigned iterations, bool binary)
+{
+    // Same path as the plugin: pooled buffers from a per-thread builder
+    MessageBuilder builder;
+    size_t bytes = 0;
+
+    // Warm up the pool and the writer stack first
+    release_message(encode_message(result, builder, binary));
+    uint64_t allocs_1 = CountingAllocator::get_count();
+    auto t1 = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < iterations; i++) {
+        MessageBuffer *buffer = encode_message(result, builder, binary);
+        bytes += buffer->GetSize();
+        release_message(buffer);
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+    uint64_t allocs_2 = CountingAllocator::get_count();
+
+    double nsec = std::chrono::duration<double, std::nano>(t2 - t1).count();
+    printf("%-34s %10.1f ns/msg %8zu bytes/msg %8llu allocs\n", name, nsec / iterations,
+        bytes / iterations, (unsigned long long)(allocs_2 - allocs_1));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    unsigned num_objects = argc > 2 ? atoi(argv[2]) : 8;
+
+    RegionTrackingResult tracking = {};
+    for (unsigned i = 0; i < 4; i++) {
+        tracking.rect[i] = 0.123456789 * (i + 1);
+        tracking.previous_rect[i] = 0.120000001 * (i + 1);
+    }
+    tracking.frame = 123456;
+    tracking.age = 789;
+    tracking.psr = 12.3456789;
+    tracking.tracker_nsec = 1234567;
+    tracking.scale_updates = 100;
+    tracking.noscale_updates = 300;
+    tracking.frame_time = 1541234567.123456;
+
+    ObjectDetectionResult detection;
+    detection.frame = 123456;
+    detection.detector_nsec = 45678901;
+    detection.frame_time = 1541234567.123456;
+    detection.objects.resize(num_objects);
+    for (unsigned n = 0; n < num_objects; n++) {
+        DetectedObject &obj = detection.objects[n];
+        for (unsigned i = 0; i < 4; i++) {
+            obj.rect[i] = -0.5 + 0.0123456789 * (n * 4 + i);
+        }
+        obj.prob = 0.5 + 0.01 * n;
+        obj.class_id = n % 5;
+        obj.label = labels[obj.class_id];
+    }
+
+    printf("%u iterations, %u objects per detection\n", iterations, num_objects);
+    bench("CameraRegionTracking json", tracking, iterations, false);
+    bench("CameraRegionTracking binary", tracking, iterations, true);
+    bench("CameraObjectDetection json", detection, iterations, false);
+    bench("CameraObjectDetection binary", detection, iterations, true);
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Wire size and decode cost of CameraOverlayScene messages under permessage-deflate.
+//
+// Builds a run of text-like overlay scenes where a few glyphs change between
+// scenes, then compresses them the way RFC 7692 does (raw deflate, sync flush,
+// trailing 00 00 ff ff removed) for several levels, window sizes and with or
+// without context takeover. Reports bytes on the wire and the receiver's inflate
+// and JSON parse time per scene.
+//
+// Usage: scene-deflate-bench [quads per scene] [scenes]
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsec_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - t).count();
+}
+
+static void write_vec4(rapidjson::Writer<rapidjson::StringBuffer> &writer, const char *key,
+    double a, double b, double c, double d)
+{
+    writer.Key(key);
+    writer.StartArray();
+    writer.Double(a);
+    writer.Double(b);
+    writer.Double(c);
+    writer.Double(d);
+    writer.EndArray();
+}
+
+// Glyphs from a 16x16 font atlas laid out in lines of text, like the controller's overlay
+static std::string make_scene(unsigned num_quads, unsigned scene_index)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    writer.StartObject();
+    writer.Key("Stream");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("timestamp");
+    writer.Double(1000.0 + scene_index / 60.0);
+    writer.Key("message");
+    writer.StartObject();
+    writer.Key("CameraOverlayScene");
+    writer.StartArray();
+
+    const unsigned columns = 80;
+    for (unsigned i = 0; i < num_quads; i++) {
+        unsigned col = i % columns;
+        unsigned row = i / columns;
+
+        // Mostly static text, with a changing readout at the start of every line
+        unsigned glyph = 32 + (i * 7 + row) % 95;
+        if (col < 6) {
+            glyph = '0' + (scene_index * (col + 1) + row) % 10;
+        }
+
+        writer.StartObject();
+        write_vec4(writer, "src", (glyph % 16) / 16.0, (glyph / 16) / 16.0, 1 / 16.0, 1 / 16.0);
+        write_vec4(writer, "dest", -0.98 + col * 0.0245, -0.95 + row * 0.04375, 0.0245, 0.04375);
+        if (row % 4 == 0) {
+            write_vec4(writer, "rgba", 1.0, 0.85, 0.2, 1.0);
+        } else {
+            write_vec4(writer, "rgba", 0.9, 0.9, 0.9, 0.8);
+        }
+        writer.EndObject();
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndObject();
+    writer.EndArray();
+    writer.EndObject();
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+static void bench(std::vector<std::string> const &scenes, int level, int window_bits, bool context_takeover)
+{
+    z_stream deflater, inflater;
+    memset(&deflater, 0, sizeof deflater);
+    memset(&inflater, 0, sizeof inflater);
+    deflateInit2(&deflater, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY);
+    inflateInit2(&inflater, -15);
+
+    std::vector<unsigned char> wire, decoded;
+    size_t raw_bytes = 0, wire_bytes = 0;
+    double deflate_nsec = 0, inflate_nsec = 0, parse_nsec = 0;
+
+    for (std::string const &scene : scenes) {
+        wire.resize(deflateBound(&deflater, scene.size()) + 16);
+        Clock::time_point t = Clock::now();
+        deflater.next_in = (Bytef*) scene.data();
+        deflater.avail_in = (uInt) scene.size();
+        deflater.next_out = wire.data();
+        deflater.avail_out = (uInt) wire.size();
+        deflate(&deflater, Z_SYNC_FLUSH);
+        size_t size = wire.size() - deflater.avail_out - 4;
+        if (!context_takeover) {
+            deflateReset(&deflater);
+        }
+        deflate_nsec += nsec_since(t);
+
+        // The receiver puts back the 00 00 ff ff tail before inflating
+        static const unsigned char tail[] = { 0x00, 0x00, 0xff, 0xff };
+        memcpy(wire.data() + size, tail, sizeof tail);
+        decoded.resize(scene.size() + 1);
+        t = Clock::now();
+        inflater.next_in = wire.data();
+        inflater.avail_in = (uInt)(size + sizeof tail);
+        inflater.next_out = decoded.data();
+        inflater.avail_out = (uInt) decoded.size();
+        inflate(&inflater, Z_SYNC_FLUSH);
+        if (!context_takeover) {
+            inflateReset(&inflater);
+        }
+        inflate_nsec += nsec_since(t);
+
+        size_t decoded_size = decoded.size() - inflater.avail_out;
+        if (decoded_size != scene.size() || memcmp(decoded.data(), scene.data(), decoded_size)) {
+            fprintf(stderr, "Round trip mismatch\n");
+            exit(1);
+        }
+
+        decoded[decoded_size] = '\0';
+        t = Clock::now();
+        rapidjson::Document doc;
+        doc.ParseInsitu((char*) decoded.data());
+        parse_nsec += nsec_since(t);
+
+        raw_bytes += scene.size();
+        wire_bytes += size;
+    }
+
+    deflateEnd(&deflater);
+    inflateEnd(&inflater);
+
+    size_t n = scenes.size();
+    printf("level %d window %2d %-11s %9zu -> %8zu bytes/scene (%5.1f%%)  deflate %8.1f us  inflate %7.1f us  parse %8.1f us\n",
+        level, window_bits, context_takeover ? "takeover" : "no-takeover",
+        raw_bytes / n, wire_bytes / n, 100.0 * wire_bytes / raw_bytes,
+        deflate_nsec / n / 1e3, inflate_nsec / n / 1e3, parse_nsec / n / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned num_quads = argc > 1 ? atoi(argv[1]) : 4000;
+    unsigned num_scenes = argc > 2 ? atoi(argv[2]) : 60;
+
+    std::vector<std::string> scenes;
+    for (unsigned i = 0; i < num_scenes; i++) {
+        scenes.push_back(make_scene(num_quads, i));
+    }
+
+    printf("%u scenes of %u quads\n", num_scenes, num_quads);
+    static const int levels[] = { 1, 6, 9 };
+    for (int level : levels) {
+        bench(scenes, level, 15, true);
+        bench(scenes, level, 15, false);
+    }
+    bench(scenes, 6, 10, true);
+    return 0;
+}
@@ -0,0 +1,243 @@
+// Receive-side cost of CameraOverlayScene messages, from payload to vertex data.
+//
+// Compares the DOM path (ParseInsitu, then json_vec4 per item) against the
+// streaming parser in overlay-scene-parser.h, which writes quads into the sink
+// during the SAX pass. Both fill the same vertex arrays laid out like the
+// overlay's vertex buffer, and the results are checked against each other.
+//
+// Usage: scene-parse-bench [quads per scene] [scenes]
+
+#include "overlay-scene-parser.h"
+#include "json-util.h"
+#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double nsec_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - t).count();
+}
+
+// Same vertex layout and corner order as OverlayDrawing
+struct VertexArrays : public OverlaySceneSink {
+    std::vector<float> points;      // x, y, z
+    std::vector<float> texcoords;   // u, v
+    std::vector<uint32_t> colors;
+    unsigned num_quads;
+    bool complete;
+
+    VertexArrays() : num_quads(0), complete(false) {}
+
+    void begin_scene() override {
+        num_quads = 0;
+        complete = false;
+    }
+
+    void add_quad(OverlayQuad const &quad) override {
+        if ((num_quads + 1) * 4 > colors.size()) {
+            size_t size = std::max<size_t>(1024, colors.size() * 2);
+            points.resize(size * 3);
+            texcoords.resize(size * 2);
+            colors.resize(size);
+        }
+
+        float *p = &points[num_quads * 12];
+        float *t = &texcoords[num_quads * 8];
+        uint32_t *c = &colors[num_quads * 4];
+        const double *src = quad.src;
+        const double *dest = quad.dest;
+
+        c[0] = c[1] = c[2] = c[3] = quad.color;
+
+        t[0] = (float)src[0];          t[1] = (float)src[1];
+        t[2] = (float)(src[0]+src[2]); t[3] = (float)src[1];
+        t[4] = (float)src[0];          t[5] = (float)(src[1]+src[3]);
+        t[6] = (float)(src[0]+src[2]); t[7] = (float)(src[1]+src[3]);
+
+        p[0] = (float)dest[0];           p[1] = (float)dest[1];           p[2] = 0.0f;
+        p[3] = (float)(dest[0]+dest[2]); p[4] = (float)dest[1];           p[5] = 0.0f;
+        p[6] = (float)dest[0];           p[7] = (float)(dest[1]+dest[3]); p[8] = 0.0f;
+        p[9] = (float)(dest[0]+dest[2]); p[10] = (float)(dest[1]+dest[3]); p[11] = 0.0f;
+
+        num_quads++;
+    }
+
+    void end_scene(bool scene_complete) override {
+        complete = scene_complete;
+    }
+
+    bool publish_scene() override {
+        return complete;
+    }
+};
+
+static void write_vec4(rapidjson::Writer<rapidjson::StringBuffer> &writer, const char *key,
+    double a, double b, double c, double d)
+{
+    writer.Key(key);
+    writer.StartArray();
+    writer.Double(a);
+    writer.Double(b);
+    writer.Double(c);
+    writer.Double(d);
+    writer.EndArray();
+}
+
+// A Stream message holding one scene of glyph-sized quads
+static std::string make_scene(unsigned num_quads, unsigned scene_index)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    writer.StartObject();
+    writer.Key("Stream");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("timestamp");
+    writer.Double(1000.0 + scene_index / 60.0);
+    writer.Key("message");
+    writer.StartObject();
+    writer.Key("CameraOverlayScene");
+    writer.StartArray();
+
+    const unsigned columns = 250;
+    for (unsigned i = 0; i < num_quads; i++) {
+        unsigned col = i % columns;
+        unsigned row = i / columns;
+        unsigned glyph = 32 + (i * 7 + row + scene_index) % 95;
+
+        writer.StartObject();
+        write_vec4(writer, "src", (glyph % 16) / 16.0, (glyph / 16) / 16.0, 1 / 16.0, 1 / 16.0);
+        write_vec4(writer, "dest", -1.0 + col * 0.008, -1.0 + row * 0.005, 0.008, 0.005);
+        write_vec4(writer, "rgba", (i % 17) / 16.0, 0.85, 0.2 + (row % 5) * 0.1, 0.8);
+        writer.EndObject();
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndObject();
+    writer.EndArray();
+    writer.EndObject();
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+// The previous receive path: full DOM, then a walk over the scene
+static void parse_dom(char *payload, VertexArrays &out)
+{
+    rapidjson::Document doc;
+    doc.ParseInsitu(payload);
+
+    out.begin_scene();
+    rapidjson::Value const *stream = json_obj(doc, "Stream");
+    if (!stream || !stream->IsArray()) {
+        return;
+    }
+    for (rapidjson::SizeType s = 0; s < stream->Size(); s++) {
+        rapidjson::Value const *msg = json_obj((*stream)[s], "message");
+        rapidjson::Value const *scene = msg ? json_obj(*msg, "CameraOverlayScene") : 0;
+        if (!scene || !scene->IsArray()) {
+            continue;
+        }
+        out.begin_scene();
+        for (rapidjson::SizeType i = 0; i < scene->Size(); i++) {
+            OverlayQuad quad;
+            double rgba[4];
+            json_vec4((*scene)[i], "src", quad.src);
+            json_vec4((*scene)[i], "dest", quad.dest);
+            json_vec4((*scene)[i], "rgba", rgba);
+
+            uint32_t color = 0;
+            for (unsigned c = 0; c < 4; c++) {
+                uint8_t byte = (uint8_t)std::max(0.0, std::min(255.0, round(rgba[c] * 255.0)));
+                color |= (uint32_t) byte << (c * 8);
+            }
+            quad.color = color;
+            quad.id = OVERLAY_NO_ID;
+            out.add_quad(quad);
+        }
+        out.end_scene(true);
+    }
+}
+
+static void parse_streaming(char *payload, VertexArrays &out, OverlaySceneParser &parser)
+{
+    rapidjson::Document doc;
+    auto generator = [&] (rapidjson::Document &handler) {
+        OverlaySceneFilter<rapidjson::Document> filter(handler, parser, &out, true);
+        rapidjson::InsituStringStream stream(payload);
+        rapidjson::Reader reader;
+        return !reader.Parse<rapidjson::kParseInsituFlag>(stream, filter).IsError();
+    };
+    doc.Populate(generator);
+}
+
+static size_t vertex_bytes(VertexArrays const &a)
+{
+    return a.num_quads * 4 * (3 * sizeof(float) + 2 * sizeof(float) + sizeof(uint32_t));
+}
+
+// Byte for byte, so a rounding difference in either parser counts as a mismatch
+static bool same_vertices(VertexArrays const &a, VertexArrays const &b)
+{
+    size_t n = a.num_quads * 4;
+    return a.num_quads == b.num_quads && a.complete && b.complete &&
+        !memcmp(a.points.data(), b.points.data(), n * 3 * sizeof(float)) &&
+        !memcmp(a.texcoords.data(), b.texcoords.data(), n * 2 * sizeof(float)) &&
+        !memcmp(a.colors.data(), b.colors.data(), n * sizeof(uint32_t));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned num_quads = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned num_scenes = argc > 2 ? atoi(argv[2]) : 20;
+
+    std::vector<std::string> scenes;
+    size_t total_bytes = 0;
+    for (unsigned i = 0; i < num_scenes; i++) {
+        scenes.push_back(make_scene(num_quads, i));
+        total_bytes += scenes.back().size();
+    }
+
+    VertexArrays dom_out, stream_out;
+    OverlaySceneParser parser(1024 * 1024);
+    double dom_nsec = 0, stream_nsec = 0;
+    size_t compared_bytes = 0;
+    std::string payload;
+
+    for (std::string const &scene : scenes) {
+        // Insitu parsing consumes the payload; both paths get a fresh copy outside the timing
+        payload = scene;
+        Clock::time_point t = Clock::now();
+        parse_dom(&payload[0], dom_out);
+        dom_nsec += nsec_since(t);
+
+        payload = scene;
+        t = Clock::now();
+        parse_streaming(&payload[0], stream_out, parser);
+        stream_nsec += nsec_since(t);
+
+        if (!same_vertices(dom_out, stream_out)) {
+            fprintf(stderr, "Vertex mismatch between DOM and streaming parse\n");
+            return 1;
+        }
+        compared_bytes += vertex_bytes(stream_out);
+    }
+
+    double mb = total_bytes / 1e6;
+    printf("%u scenes of %u quads, %.1f MB/scene\n", num_scenes, num_quads, mb / num_scenes);
+    printf("dom        %8.2f ms/scene  %7.1f MB/s\n", dom_nsec / num_scenes / 1e6, mb / (dom_nsec / 1e9));
+    printf("streaming  %8.2f ms/scene  %7.1f MB/s\n", stream_nsec / num_scenes / 1e6, mb / (stream_nsec / 1e9));
+    printf("vertices identical, %.1f MB compared\n", compared_bytes / 1e6);
+    return 0;
+}
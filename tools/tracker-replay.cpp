@@ -0,0 +1,189 @@
+// Replays tracker recordings (.tfr files from FrameRecorder) through two
+// correlation_trackers side by side: one fed the RGB frame as dlib converts it,
+// one fed the float gray image that TrackerFeatureCache builds for the plugin.
+// Reports PSR, update time and how far apart the two tracks drift.
+//
+// Every TAG_INIT record restarts both trackers from the recorded rect. Both use
+// update() with scale estimation on every frame, unlike the plugin, which lets
+// TrackerScaleScheduler skip it; that keeps the comparison about the input alone.
+//
+// Usage: tracker-replay <recording.tfr> [more recordings...]
+
+#include "frame-recorder.h"
+#include <dlib/array2d.h>
+#include <dlib/pixel.h>
+#include <dlib/image_processing/correlation_tracker.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+using namespace dlib;
+
+typedef std::chrono::steady_clock Clock;
+
+// Same as TrackerScaleScheduler's LOW_PSR_THRESHOLD, below which it forces a scale update
+#define LOW_PSR             7.0
+
+static double nsec_since(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - t).count();
+}
+
+// Same arithmetic as TrackerFeatureCache::gray_row()
+static void build_gray(array2d<rgb_pixel> const &rgb, array2d<float> &gray)
+{
+    const float third = 1.0f / 3.0f;
+    gray.set_size(rgb.nr(), rgb.nc());
+    for (long y = 0; y < rgb.nr(); y++) {
+        for (long x = 0; x < rgb.nc(); x++) {
+            rgb_pixel const &pix = rgb[y][x];
+            gray[y][x] = (pix.red + pix.green + pix.blue) * third;
+        }
+    }
+}
+
+struct Totals {
+    uint64_t updates;
+    double psr_sum;
+    double psr_min;
+    uint64_t low_psr;
+    double update_nsec;
+
+    Totals() : updates(0), psr_sum(0), psr_min(INFINITY), low_psr(0), update_nsec(0) {}
+
+    void add(double psr, double nsec) {
+        // The tracker can produce NaN; the plugin reports those as 0
+        if (!(psr >= 0.0)) psr = 0.0;
+        updates++;
+        psr_sum += psr;
+        psr_min = std::min(psr_min, psr);
+        low_psr += psr < LOW_PSR;
+        update_nsec += nsec;
+    }
+
+    void print(const char *name) {
+        if (!updates) {
+            printf("%-5s no updates\n", name);
+            return;
+        }
+        printf("%-5s PSR mean %6.2f  min %6.2f  below %.0f: %5.1f%%  update %7.1f us\n",
+            name, psr_sum / updates, psr_min, LOW_PSR, 100.0 * low_psr / updates,
+            update_nsec / updates / 1e3);
+    }
+};
+
+struct Divergence {
+    uint64_t count;
+    double center_sum;
+    double center_max;
+    double area_ratio_sum;
+
+    Divergence() : count(0), center_sum(0), center_max(0), area_ratio_sum(0) {}
+
+    void add(drectangle const &a, drectangle const &b) {
+        double d = length(center(a) - center(b));
+        count++;
+        center_sum += d;
+        center_max = std::max(center_max, d);
+        area_ratio_sum += a.area() > 0 ? b.area() / a.area() : 0.0;
+    }
+};
+
+static bool replay(const char *path, Totals &rgb_totals, Totals &gray_totals, Divergence &divergence)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: can't open\n", path);
+        return false;
+    }
+
+    FrameRecorder::FileHeader fh;
+    if (fread(&fh, sizeof fh, 1, f) != 1 || memcmp(fh.magic, "TFRC", 4)) {
+        fprintf(stderr, "%s: not a tracker recording\n", path);
+        fclose(f);
+        return false;
+    }
+    if (fh.version < 2) {
+        fprintf(stderr, "%s: version %u has no init rects, can't replay\n", path, fh.version);
+        fclose(f);
+        return false;
+    }
+
+    correlation_tracker rgb_tracker(6, 4), gray_tracker(6, 4);
+    bool tracking = false;
+    unsigned inits = 0, frames = 0;
+
+    FrameRecorder::RecordHeader rh;
+    std::vector<uint8_t> data;
+    array2d<rgb_pixel> rgb;
+    array2d<float> gray;
+
+    while (fread(&rh, sizeof rh, 1, f) == 1) {
+        if (memcmp(rh.magic, "FRAM", 4) || !rh.height || rh.size % rh.height) {
+            fprintf(stderr, "%s: bad record after %u frames\n", path, frames);
+            break;
+        }
+        data.resize(rh.size);
+        if (fread(data.data(), 1, rh.size, f) != rh.size) {
+            fprintf(stderr, "%s: truncated after %u frames\n", path, frames);
+            break;
+        }
+        frames++;
+
+        // Rows were written with the grabber's stride, which may exceed width * 3
+        uint32_t stride = rh.size / rh.height;
+        rgb.set_size(rh.height, rh.width);
+        for (uint32_t y = 0; y < rh.height; y++) {
+            memcpy(&rgb[y][0], &data[y * stride], rh.width * sizeof(rgb_pixel));
+        }
+        build_gray(rgb, gray);
+
+        if (rh.tag == FrameRecorder::TAG_INIT) {
+            drectangle rect(rh.rect[0], rh.rect[1], rh.rect[2], rh.rect[3]);
+            rgb_tracker.start_track(rgb, rect);
+            gray_tracker.start_track(gray, rect);
+            tracking = true;
+            inits++;
+        } else if (tracking) {
+            Clock::time_point t = Clock::now();
+            double psr = rgb_tracker.update(rgb);
+            rgb_totals.add(psr, nsec_since(t));
+
+            t = Clock::now();
+            psr = gray_tracker.update(gray);
+            gray_totals.add(psr, nsec_since(t));
+
+            divergence.add(rgb_tracker.get_position(), gray_tracker.get_position());
+        }
+    }
+
+    printf("%s: %u frames, %u tracks\n", path, frames, inits);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: tracker-replay <recording.tfr> [more recordings...]\n");
+        return 1;
+    }
+
+    Totals rgb_totals, gray_totals;
+    Divergence divergence;
+    for (int i = 1; i < argc; i++) {
+        replay(argv[i], rgb_totals, gray_totals, divergence);
+    }
+
+    printf("\n");
+    rgb_totals.print("rgb");
+    gray_totals.print("gray");
+    if (divergence.count) {
+        printf("gray vs rgb center distance mean %.2f px  max %.2f px, area ratio mean %.3f\n",
+            divergence.center_sum / divergence.count, divergence.center_max,
+            divergence.area_ratio_sum / divergence.count);
+    }
+    return 0;
+}
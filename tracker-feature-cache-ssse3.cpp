@@ -0,0 +1,37 @@
+#include "tracker-feature-cache.h"
+
+// Built with SSSE3 enabled (see CMakeLists.txt), and only called once
+// TrackerFeatureCache::cpu_has_ssse3() has said the CPU supports it.
+
+#if defined(__SSSE3__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <tmmintrin.h>
+
+void TrackerFeatureCache::gray_row_ssse3(const uint8_t *src, float *dest, long cols)
+{
+    const __m128i shuf_r = _mm_setr_epi8(0,-1,-1,-1, 3,-1,-1,-1, 6,-1,-1,-1, 9,-1,-1,-1);
+    const __m128i shuf_g = _mm_setr_epi8(1,-1,-1,-1, 4,-1,-1,-1, 7,-1,-1,-1, 10,-1,-1,-1);
+    const __m128i shuf_b = _mm_setr_epi8(2,-1,-1,-1, 5,-1,-1,-1, 8,-1,-1,-1, 11,-1,-1,-1);
+    const __m128 scale = _mm_set1_ps(1.0f / 3.0f);
+    long x = 0;
+
+    // Four pixels per step; each 16-byte load must stay inside the row
+    for (; x * 3 + 16 <= cols * 3; x += 4) {
+        __m128i pix = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+        __m128i sum = _mm_add_epi32(_mm_shuffle_epi8(pix, shuf_r),
+                      _mm_add_epi32(_mm_shuffle_epi8(pix, shuf_g),
+                                    _mm_shuffle_epi8(pix, shuf_b)));
+        _mm_storeu_ps(dest + x, _mm_mul_ps(_mm_cvtepi32_ps(sum), scale));
+    }
+
+    gray_row(src + x * 3, dest + x, cols - x);
+}
+
+#else
+
+// Not an x86 build; cpu_has_ssse3() is always false there
+void TrackerFeatureCache::gray_row_ssse3(const uint8_t *src, float *dest, long cols)
+{
+    gray_row(src, dest, cols);
+}
+
+#endif
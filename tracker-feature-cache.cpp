@@ -0,0 +1,81 @@
+#include "tracker-feature-cache.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define FEATURE_CACHE_X86
+#elif defined(__x86_64__) || defined(__i386__)
+#define FEATURE_CACHE_X86
+#endif
+
+using namespace dlib;
+
+TrackerFeatureCache::TrackerFeatureCache()
+    : counter(0),
+      rgb(0),
+      gray_valid(false),
+      use_ssse3(cpu_has_ssse3())
+{}
+
+void TrackerFeatureCache::set_frame(ImageGrabber::Frame const &frame)
+{
+    rgb = static_cast<const array2d<rgb_pixel>*>(frame.image);
+    counter = frame.counter;
+    gray_valid = false;
+}
+
+unsigned TrackerFeatureCache::get_frame_counter()
+{
+    return counter;
+}
+
+const TrackerFeatureCache::gray_image& TrackerFeatureCache::gray()
+{
+    build_gray();
+    return gray_img;
+}
+
+void TrackerFeatureCache::build_gray()
+{
+    if (gray_valid || !rgb) {
+        return;
+    }
+
+    const long rows = rgb->nr();
+    const long cols = rgb->nc();
+    gray_img.set_size(rows, cols);
+
+    for (long y = 0; y < rows; y++) {
+        const uint8_t *src = reinterpret_cast<const uint8_t*>(&(*rgb)[y][0]);
+        float *dest = &gray_img[y][0];
+        if (use_ssse3) {
+            gray_row_ssse3(src, dest, cols);
+        } else {
+            gray_row(src, dest, cols);
+        }
+    }
+
+    gray_valid = true;
+}
+
+void TrackerFeatureCache::gray_row(const uint8_t *src, float *dest, long cols)
+{
+    // Intensity matches dlib's get_pixel_intensity() for rgb_pixel, without the integer rounding
+    const float third = 1.0f / 3.0f;
+    for (long x = 0; x < cols; x++) {
+        const uint8_t *pix = src + x * 3;
+        dest[x] = (pix[0] + pix[1] + pix[2]) * third;
+    }
+}
+
+bool TrackerFeatureCache::cpu_has_ssse3()
+{
+#if defined(FEATURE_CACHE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#elif defined(FEATURE_CACHE_X86)
+    return __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
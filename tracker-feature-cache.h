@@ -0,0 +1,38 @@
+#pragma once
+#include "image-grabber.h"
+#include <dlib/array2d.h>
+#include <dlib/pixel.h>
+#include <stdint.h>
+
+// Per-frame image features for one FlyerVisionTracker. Each tracker keeps its own
+// cache and uses it only from its SerialTask, so nothing here is locked. The owner
+// calls set_frame() once when a tracker frame is consumed; each feature is then
+// built on first use, and reused by every tracker call on that frame.
+
+class TrackerFeatureCache {
+public:
+    typedef dlib::array2d<float> gray_image;
+
+    TrackerFeatureCache();
+
+    void set_frame(ImageGrabber::Frame const &frame);
+    unsigned get_frame_counter();
+
+    const gray_image& gray();
+
+private:
+    unsigned counter;
+    const dlib::array2d<dlib::rgb_pixel> *rgb;
+
+    bool gray_valid;
+    bool use_ssse3;
+
+    gray_image gray_img;
+
+    void build_gray();
+
+    static bool cpu_has_ssse3();
+    static void gray_row(const uint8_t *src, float *dest, long cols);
+    // In tracker-feature-cache-ssse3.cpp, the only file built with SSSE3 enabled
+    static void gray_row_ssse3(const uint8_t *src, float *dest, long cols);
+};
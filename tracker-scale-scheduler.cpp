@@ -0,0 +1,69 @@
+#include "tracker-scale-scheduler.h"
+#include <algorithm>
+
+#define DEFAULT_BUDGET_NSEC         4000000
+#define COST_AVERAGE_WEIGHT         0.1
+#define MAX_CREDIT_FRAMES           8.0
+#define LOW_PSR_THRESHOLD           7.0
+#define LOW_PSR_MIN_INTERVAL        4
+
+TrackerScaleScheduler::TrackerScaleScheduler()
+    : budget_nsec(DEFAULT_BUDGET_NSEC),
+      scale_count(0),
+      noscale_count(0),
+      noscale_cost(0.0),
+      scale_cost(0.0),
+      credit(0.0),
+      frames_since_scale(0)
+{}
+
+void TrackerScaleScheduler::set_budget_nsec(uint64_t nsec)
+{
+    budget_nsec.store(nsec);
+}
+
+uint64_t TrackerScaleScheduler::get_budget_nsec()
+{
+    return budget_nsec.load();
+}
+
+uint64_t TrackerScaleScheduler::get_scale_count()
+{
+    return scale_count.load();
+}
+
+uint64_t TrackerScaleScheduler::get_noscale_count()
+{
+    return noscale_count.load();
+}
+
+bool TrackerScaleScheduler::should_scale(double previous_psr)
+{
+    double budget = (double) budget_nsec.load();
+
+    // Every frame pays for at least the translation-only update; the rest is saved up
+    credit += budget - noscale_cost;
+    credit = std::max(-budget * MAX_CREDIT_FRAMES, std::min(credit, std::max(budget, scale_cost) * MAX_CREDIT_FRAMES));
+
+    // Until a scale update has been measured its cost is zero, so the first one always runs
+    double extra_cost = std::max(0.0, scale_cost - noscale_cost);
+    if (credit >= extra_cost) {
+        return true;
+    }
+    return previous_psr < LOW_PSR_THRESHOLD && frames_since_scale >= LOW_PSR_MIN_INTERVAL;
+}
+
+void TrackerScaleScheduler::record_update(bool scaled, uint64_t nsec)
+{
+    double &cost = scaled ? scale_cost : noscale_cost;
+    cost = cost ? cost + (nsec - cost) * COST_AVERAGE_WEIGHT : (double) nsec;
+
+    if (scaled) {
+        credit -= std::max(0.0, (double) nsec - noscale_cost);
+        frames_since_scale = 0;
+        scale_count++;
+    } else {
+        frames_since_scale++;
+        noscale_count++;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Decides, frame by frame, whether the tracker can afford a full scale-search update
+// or should stay with the cheaper translation-only update. Unused per-frame CPU
+// budget accumulates as credit that a scale update spends; a drop in PSR forces a
+// scale update regardless, rate-limited so a lost target can't monopolize the CPU.
+
+class TrackerScaleScheduler {
+public:
+    TrackerScaleScheduler();
+
+    void set_budget_nsec(uint64_t nsec);
+    uint64_t get_budget_nsec();
+
+    bool should_scale(double previous_psr);
+    void record_update(bool scaled, uint64_t nsec);
+
+    uint64_t get_scale_count();
+    uint64_t get_noscale_count();
+
+private:
+    std::atomic<uint64_t> budget_nsec;
+    std::atomic<uint64_t> scale_count;
+    std::atomic<uint64_t> noscale_count;
+
+    double noscale_cost;        // Moving average, nanoseconds
+    double scale_cost;
+    double credit;              // Accumulated unused budget, nanoseconds
+    unsigned frames_since_scale;
+};
@@ -0,0 +1,198 @@
+#include "vision-messages.h"
+#include <string.h>
+#include <algorithm>
+
+static void put_bytes(MessageStringBuffer &out, const void *data, size_t size)
+{
+    memcpy(out.Push(size), data, size);
+}
+
+static void put_u8(MessageStringBuffer &out, uint8_t v)
+{
+    out.Put((char) v);
+}
+
+static void put_u16(MessageStringBuffer &out, uint16_t v)
+{
+    uint8_t b[2] = { (uint8_t) v, (uint8_t)(v >> 8) };
+    put_bytes(out, b, sizeof b);
+}
+
+static void put_u32(MessageStringBuffer &out, uint32_t v)
+{
+    uint8_t b[4] = { (uint8_t) v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    put_bytes(out, b, sizeof b);
+}
+
+static void put_u64(MessageStringBuffer &out, uint64_t v)
+{
+    put_u32(out, (uint32_t) v);
+    put_u32(out, (uint32_t)(v >> 32));
+}
+
+static void put_f32(MessageStringBuffer &out, double v)
+{
+    float f = (float) v;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof bits);
+    put_u32(out, bits);
+}
+
+static void put_f64(MessageStringBuffer &out, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof bits);
+    put_u64(out, bits);
+}
+
+static void put_header(MessageStringBuffer &out, BinaryMessageType type, uint16_t count)
+{
+    put_u8(out, (uint8_t) type);
+    put_u8(out, BINARY_MESSAGE_VERSION);
+    put_u16(out, count);
+}
+
+static void write_rect(MessageWriter &writer, const double rect[4])
+{
+    writer.StartArray();
+    for (unsigned i = 0; i < 4; i++) {
+        writer.Double(rect[i]);
+    }
+    writer.EndArray();
+}
+
+static void write_frame_time(MessageWriter &writer, double frame_time)
+{
+    writer.Key("frame_time");
+    if (frame_time > 0.0) {
+        writer.Double(frame_time);
+    } else {
+        writer.Null();
+    }
+}
+
+void encode_json(RegionTrackingResult const &result, MessageWriter &writer)
+{
+    writer.StartObject();
+    writer.Key("Command");
+    writer.StartObject();
+    writer.Key("CameraRegionTracking");
+    writer.StartObject();
+
+    writer.Key("rect");
+    write_rect(writer, result.rect);
+    writer.Key("previous_rect");
+    write_rect(writer, result.previous_rect);
+    writer.Key("frame");
+    writer.Uint(result.frame);
+    writer.Key("age");
+    writer.Uint(result.age);
+    writer.Key("psr");
+    writer.Double(result.psr);
+    writer.Key("tracker_nsec");
+    writer.Uint64(result.tracker_nsec);
+    writer.Key("scaled");
+    writer.Bool(result.scaled);
+    writer.Key("scale_updates");
+    writer.Uint64(result.scale_updates);
+    writer.Key("noscale_updates");
+    writer.Uint64(result.noscale_updates);
+    write_frame_time(writer, result.frame_time);
+
+    writer.EndObject();
+    writer.EndObject();
+    writer.EndObject();
+}
+
+void encode_json(ObjectDetectionResult const &result, MessageWriter &writer)
+{
+    writer.StartObject();
+    writer.Key("Command");
+    writer.StartObject();
+    writer.Key("CameraObjectDetection");
+    writer.StartObject();
+
+    writer.Key("objects");
+    writer.StartArray();
+    for (DetectedObject const &obj : result.objects) {
+        writer.StartObject();
+        writer.Key("rect");
+        write_rect(writer, obj.rect);
+        writer.Key("prob");
+        writer.Double(obj.prob);
+        writer.Key("label");
+        writer.String(obj.label ? obj.label : "");
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("frame");
+    writer.Uint(result.frame);
+    writer.Key("detector_nsec");
+    writer.Uint64(result.detector_nsec);
+    write_frame_time(writer, result.frame_time);
+
+    writer.EndObject();
+    writer.EndObject();
+    writer.EndObject();
+}
+
+void encode_binary(RegionTrackingResult const &result, MessageStringBuffer &out)
+{
+    put_header(out, BINARY_CAMERA_REGION_TRACKING, 0);
+    put_u32(out, result.frame);
+    put_u32(out, result.age);
+    put_f32(out, result.psr);
+    put_u32(out, result.scaled ? BINARY_TRACKING_FLAG_SCALED : 0);
+    put_u64(out, result.tracker_nsec);
+    put_u32(out, (uint32_t) result.scale_updates);
+    put_u32(out, (uint32_t) result.noscale_updates);
+    for (unsigned i = 0; i < 4; i++) {
+        put_f32(out, result.rect[i]);
+    }
+    for (unsigned i = 0; i < 4; i++) {
+        put_f32(out, result.previous_rect[i]);
+    }
+    put_f64(out, result.frame_time);
+}
+
+void encode_binary(ObjectDetectionResult const &result, MessageStringBuffer &out)
+{
+    uint16_t count = (uint16_t) std::min<size_t>(result.objects.size(), UINT16_MAX);
+
+    put_header(out, BINARY_CAMERA_OBJECT_DETECTION, count);
+    put_u32(out, result.frame);
+    put_u32(out, 0);
+    put_u64(out, result.detector_nsec);
+    put_f64(out, result.frame_time);
+    for (uint16_t n = 0; n < count; n++) {
+        DetectedObject const &obj = result.objects[n];
+        for (unsigned i = 0; i < 4; i++) {
+            put_f32(out, obj.rect[i]);
+        }
+        put_f32(out, obj.prob);
+        put_u32(out, obj.class_id);
+    }
+}
+
+template <typename Result>
+static MessageBuffer *encode_either(Result const &result, MessageBuilder &builder, bool binary)
+{
+    MessageBuffer *buffer = builder.acquire();
+    if (binary) {
+        encode_binary(result, *buffer);
+    } else {
+        encode_json(result, builder.writer_for(*buffer));
+    }
+    return buffer;
+}
+
+MessageBuffer *encode_message(RegionTrackingResult const &result, MessageBuilder &builder, bool binary)
+{
+    return encode_either(result, builder, binary);
+}
+
+MessageBuffer *encode_message(ObjectDetectionResult const &result, MessageBuilder &builder, bool binary)
+{
+    return encode_either(result, builder, binary);
+}
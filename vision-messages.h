@@ -0,0 +1,80 @@
+#pragma once
+#include "message-pool.h"
+#include <stdint.h>
+#include <vector>
+
+// Results produced by the vision threads, and their two wire encodings.
+//
+// JSON is always understood by the bot controller. The binary encoding is only used
+// once the controller has accepted the "BinaryVision" feature; it is a fixed
+// little-endian record layout with float32 coordinates and detector class IDs
+// (line numbers in coco.names) in place of label strings:
+//
+//   header:                            u8 type, u8 version, u16 count
+//   CameraRegionTracking:              u32 frame, u32 age, f32 psr, u32 flags,
+//                                      u64 tracker_nsec, u32 scale_updates,
+//                                      u32 noscale_updates, f32 rect[4],
+//                                      f32 previous_rect[4], f64 frame_time
+//   CameraObjectDetection:             u32 frame, u32 reserved, u64 detector_nsec,
+//                                      f64 frame_time, then 'count' times:
+//                                      f32 rect[4], f32 prob, u32 class_id
+//
+// With the 4-byte header, a tracking record is 76 bytes and a detection record is
+// 28 bytes plus 24 per object.
+//
+// All rectangles are [left, top, width, height] in overlay coordinates. frame_time
+// is when the frame was captured, in the controller's clock (seconds, as in Stream
+// timestamps); it is 0 in binary and null in JSON until the clocks are synchronized.
+// Version 2 added frame_time.
+//
+// With the "Batch" feature, several binary records share one frame: a header with
+// type BINARY_BATCH and the record count, then each record prefixed by its u32 size.
+//
+// The controller uses the same header for BINARY_OVERLAY_DELTA frames going the
+// other way; that layout is in overlay-scene-model.h.
+
+enum BinaryMessageType {
+    BINARY_BATCH = 0,
+    BINARY_CAMERA_REGION_TRACKING = 1,
+    BINARY_CAMERA_OBJECT_DETECTION = 2,
+    BINARY_OVERLAY_DELTA = 3,
+};
+
+#define BINARY_MESSAGE_VERSION      2
+#define BINARY_TRACKING_FLAG_SCALED 0x1
+
+struct RegionTrackingResult {
+    double rect[4];
+    double previous_rect[4];
+    unsigned frame;
+    unsigned age;
+    double psr;
+    uint64_t tracker_nsec;
+    bool scaled;
+    uint64_t scale_updates;
+    uint64_t noscale_updates;
+    double frame_time;
+};
+
+struct DetectedObject {
+    double rect[4];
+    double prob;
+    unsigned class_id;
+    const char *label;
+};
+
+struct ObjectDetectionResult {
+    unsigned frame;
+    uint64_t detector_nsec;
+    double frame_time;
+    std::vector<DetectedObject> objects;
+};
+
+void encode_json(RegionTrackingResult const &result, MessageWriter &writer);
+void encode_json(ObjectDetectionResult const &result, MessageWriter &writer);
+void encode_binary(RegionTrackingResult const &result, MessageStringBuffer &out);
+void encode_binary(ObjectDetectionResult const &result, MessageStringBuffer &out);
+
+// Either encoding, into a pooled buffer from the builder
+MessageBuffer *encode_message(RegionTrackingResult const &result, MessageBuilder &builder, bool binary);
+MessageBuffer *encode_message(ObjectDetectionResult const &result, MessageBuilder &builder, bool binary);
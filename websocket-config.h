@@ -0,0 +1,51 @@
+#pragma once
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <stdint.h>
+#include <string>
+
+// Client side of permessage-deflate (RFC 7692). Overlay scenes are large and very
+// repetitive JSON, so we offer compression to the server; it picks the level used
+// for what it sends us. Each BotConnector keeps its own settings and puts the
+// offer from deflate_offer() on every connection it creates.
+
+struct DeflateSettings {
+    bool enabled;
+    bool no_context_takeover;   // Ask the server to reset its window for every message
+    uint8_t max_window_bits;    // 9-15, LZ77 window we ask the server to stay within
+};
+
+// Empty when compression is disabled
+inline std::string deflate_offer(DeflateSettings const &settings)
+{
+    if (!settings.enabled) {
+        return std::string();
+    }
+    std::string offer = "permessage-deflate; client_max_window_bits";
+    if (settings.no_context_takeover) {
+        offer += "; server_no_context_takeover";
+    }
+    if (settings.max_window_bits < 15) {
+        offer += "; server_max_window_bits=" + std::to_string(settings.max_window_bits);
+    }
+    return offer;
+}
+
+// Extensions are constructed inside websocketpp with no way to pass settings in, so
+// this one makes no offer of its own; websocketpp then leaves the request's
+// Sec-WebSocket-Extensions header as the connection's owner set it. It still
+// negotiates the server's response and does the inflating.
+template <typename config>
+class DeflateExtension : public websocketpp::extensions::permessage_deflate::enabled<config> {
+public:
+    std::string generate_offer() const {
+        return std::string();
+    }
+};
+
+struct DeflateClientConfig : public websocketpp::config::asio_client {
+    typedef DeflateClientConfig type;
+
+    struct permessage_deflate_config {};
+    typedef DeflateExtension<permessage_deflate_config> permessage_deflate_type;
+};